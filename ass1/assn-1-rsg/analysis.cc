@@ -0,0 +1,235 @@
+/**
+ * File: analysis.cc
+ * -----------------
+ * Provides the implementation of the GrammarAnalysis class.  Every
+ * quantity is computed as the fixed point of a simple equation over
+ * the nonterminals, found by sweeping over all of the productions
+ * until nothing changes.
+ */
+
+#include "analysis.h"
+#include <math.h>
+#include <iomanip>
+
+const uint64_t GrammarAnalysis::kUnbounded;
+
+static const int kMaxRounds = 20000;
+static const double kTolerance = 1e-12;
+static const double kDivergent = 1e15;
+static const double kCertain = 1 - 1e-3;
+
+GrammarAnalysis::GrammarAnalysis(const Grammar& grammar, int start) :
+  grammar(grammar), start(start)
+{
+  vector<double> probabilities;
+  grammar.getProbabilities(probabilities);
+  findReachable();
+  computeMinLengths();
+  computeExpectedLengths(probabilities);
+  computeTerminationProbabilities(probabilities);
+}
+
+/**
+ * Method: findReachable
+ * ---------------------
+ * A depth-first search from the start symbol over every production.
+ */
+
+void GrammarAnalysis::findReachable()
+{
+  reachable.assign(grammar.getNonterminalCount(), false);
+  vector<int> pending(1, start);
+  reachable[start] = true;
+  while (!pending.empty()) {
+    int id = pending.back();
+    pending.pop_back();
+    for (int p = grammar.beginProductions(id); p < grammar.endProductions(id); p++) {
+      for (const Grammar::symbol *s = grammar.beginSymbols(p); s != grammar.endSymbols(p); ++s) {
+	int index = Grammar::indexOf(*s);
+	if (Grammar::isNonterminal(*s) && !reachable[index]) {
+	  reachable[index] = true;
+	  pending.push_back(index);
+	}
+      }
+    }
+  }
+}
+
+/**
+ * Method: computeMinLengths
+ * -------------------------
+ * Every nonterminal starts out unbounded, and each sweep lowers it to
+ * the cheapest of its productions given the current estimates.  The
+ * estimates only ever fall, and the shortest expansion of any nonterminal
+ * is at most as tall as there are nonterminals, so the sweeps stop after
+ * at most that many rounds.  Nonterminals that never fall are unproductive.
+ */
+
+void GrammarAnalysis::computeMinLengths()
+{
+  minLength.assign(grammar.getNonterminalCount(), kUnbounded);
+  productionMinLength.assign(grammar.getProductionCount(), kUnbounded);
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (int id = 0; id < grammar.getNonterminalCount(); id++) {
+      for (int p = grammar.beginProductions(id); p < grammar.endProductions(id); p++) {
+	uint64_t length = 0;
+	for (const Grammar::symbol *s = grammar.beginSymbols(p); s != grammar.endSymbols(p); ++s) {
+	  int index = Grammar::indexOf(*s);
+	  uint64_t cost = Grammar::isNonterminal(*s) ? minLength[index] : grammar.getTerminalLength(index) + 1;
+	  length = (cost == kUnbounded) ? kUnbounded : length + cost;
+	  if (length == kUnbounded) break;
+	}
+
+	productionMinLength[p] = length;
+	if (length < minLength[id]) {
+	  minLength[id] = length;
+	  changed = true;
+	}
+      }
+    }
+  }
+}
+
+/**
+ * Function: estimateExpectedLength
+ * --------------------------------
+ * Computes the right hand side of the expected length equation for
+ * a single nonterminal, given the current estimates for all of them.
+ */
+
+static double estimateExpectedLength(const Grammar& grammar, int id, const vector<double>& probabilities,
+				     const vector<double>& expectedLength)
+{
+  double length = 0.0;
+  for (int p = grammar.beginProductions(id); p < grammar.endProductions(id); p++) {
+    double sum = 0.0;
+    for (const Grammar::symbol *s = grammar.beginSymbols(p); s != grammar.endSymbols(p); ++s) {
+      int index = Grammar::indexOf(*s);
+      sum += Grammar::isNonterminal(*s) ? expectedLength[index] : grammar.getTerminalLength(index) + 1;
+    }
+    if (probabilities[p] > 0) length += probabilities[p] * sum;
+  }
+
+  return length > kDivergent ? HUGE_VAL : length;
+}
+
+/**
+ * Method: computeExpectedLengths
+ * ------------------------------
+ * The expected lengths satisfy E[X] = sum over X's productions of
+ * P(production) * (sum of the expected lengths of its symbols).  Starting
+ * from zero, each sweep moves the estimates up toward the smallest
+ * solution, which is the true expectation.  If an estimate is still
+ * climbing after kMaxRounds sweeps, or it blows past kDivergent, the
+ * expectation is taken to be infinite, and so is the expectation of
+ * everything that can expand into it.
+ */
+
+void GrammarAnalysis::computeExpectedLengths(const vector<double>& probabilities)
+{
+  int count = grammar.getNonterminalCount();
+  expectedLength.assign(count, 0.0);
+  for (int round = 0; round < kMaxRounds; round++) {
+    bool changed = false;
+    for (int id = 0; id < count; id++) {
+      double length = estimateExpectedLength(grammar, id, probabilities, expectedLength);
+      if (fabs(length - expectedLength[id]) > kTolerance * max(1.0, length)) changed = true;
+      expectedLength[id] = length;
+    }
+    if (!changed) return;
+  }
+
+  for (int id = 0; id < count; id++) {
+    double length = estimateExpectedLength(grammar, id, probabilities, expectedLength);
+    if (fabs(length - expectedLength[id]) > kTolerance * max(1.0, length)) expectedLength[id] = HUGE_VAL;
+  }
+
+  for (int round = 0; round < count; round++) {
+    for (int id = 0; id < count; id++) {
+      if (isinf(estimateExpectedLength(grammar, id, probabilities, expectedLength)))
+	expectedLength[id] = HUGE_VAL;
+    }
+  }
+}
+
+/**
+ * Method: computeTerminationProbabilities
+ * ---------------------------------------
+ * The probability that X finishes satisfies q[X] = sum over X's
+ * productions of P(production) * (product of the probabilities that each
+ * of its nonterminals finishes).  As with the expected lengths, sweeping
+ * upward from zero converges on the smallest solution, which is the
+ * true probability.  Convergence is geometric unless the grammar is
+ * critical (as likely to grow as to shrink), in which case the estimate
+ * creeps toward 1 and ends up just shy of it; that's why anything
+ * within kCertain of 1 is treated as certain.
+ */
+
+void GrammarAnalysis::computeTerminationProbabilities(const vector<double>& probabilities)
+{
+  int count = grammar.getNonterminalCount();
+  terminationProbability.assign(count, 0.0);
+  for (int round = 0; round < kMaxRounds; round++) {
+    bool changed = false;
+    for (int id = 0; id < count; id++) {
+      double probability = 0.0;
+      for (int p = grammar.beginProductions(id); p < grammar.endProductions(id); p++) {
+	double product = probabilities[p];
+	for (const Grammar::symbol *s = grammar.beginSymbols(p); s != grammar.endSymbols(p); ++s)
+	  if (Grammar::isNonterminal(*s)) product *= terminationProbability[Grammar::indexOf(*s)];
+	probability += product;
+      }
+
+      probability = min(probability, 1.0);
+      if (probability - terminationProbability[id] > kTolerance) changed = true;
+      terminationProbability[id] = probability;
+    }
+    if (!changed) return;
+  }
+}
+
+bool GrammarAnalysis::isPathological() const
+{
+  for (int id = 0; id < grammar.getNonterminalCount(); id++) {
+    if (!reachable[id]) continue;
+    if (!isProductive(id) || terminationProbability[id] < kCertain || isinf(expectedLength[id]))
+      return true;
+  }
+  return false;
+}
+
+/**
+ * Method: print
+ * -------------
+ * Lengths that are unbounded or infinite are printed as "-".
+ */
+
+void GrammarAnalysis::print(ostream& out) const
+{
+  out << left << setw(32) << "nonterminal" << right << setw(10) << "reachable"
+      << setw(11) << "productive" << setw(12) << "min length" << setw(16) << "expected length"
+      << setw(13) << "terminates" << endl;
+  for (int id = 0; id < grammar.getNonterminalCount(); id++) {
+    out << left << setw(32) << grammar.getNonterminal(id) << right
+	<< setw(10) << (reachable[id] ? "yes" : "no")
+	<< setw(11) << (isProductive(id) ? "yes" : "no");
+    if (isProductive(id)) out << setw(12) << minLength[id];
+    else out << setw(12) << "-";
+    if (isinf(expectedLength[id])) out << setw(16) << "-";
+    else out << setw(16) << fixed << setprecision(1) << expectedLength[id];
+    out << setw(13) << fixed << setprecision(4) << terminationProbability[id] << endl;
+  }
+
+  for (int id = 0; id < grammar.getNonterminalCount(); id++) {
+    if (!reachable[id]) continue;
+    string name = grammar.getNonterminal(id);
+    if (!isProductive(id))
+      out << "warning: " << name << " can never finish expanding; every production leads back to a cycle." << endl;
+    else if (terminationProbability[id] < kCertain)
+      out << "warning: " << name << " finishes expanding with probability " << terminationProbability[id] << "." << endl;
+    else if (isinf(expectedLength[id]))
+      out << "warning: " << name << " has an infinite expected length." << endl;
+  }
+}
@@ -0,0 +1,115 @@
+/**
+ * File: analysis.h
+ * ----------------
+ * Defines the GrammarAnalysis class, which computes static facts
+ * about a compiled Grammar: which nonterminals can be reached from
+ * the start symbol, which ones can ever finish expanding, how short
+ * their expansions can possibly be, and how long they are on average
+ * when productions are chosen the way the Expander chooses them.
+ *
+ * Lengths are measured in bytes, with each terminal counting one extra
+ * byte for the space that separates it from its neighbour.  A complete
+ * sentence is therefore one byte shorter than the length of <start>.
+ */
+
+#ifndef __analysis__
+#define __analysis__
+
+#include "grammar.h"
+#include <stdint.h>
+#include <ostream>
+#include <vector>
+using namespace std;
+
+class GrammarAnalysis {
+
+ public:
+
+  static const uint64_t kUnbounded = UINT64_MAX;
+
+  /**
+   * Constructor: GrammarAnalysis
+   * ----------------------------
+   * Analyzes the specified Grammar with respect to the specified start
+   * symbol.  The Grammar must have no undefined nonterminals.
+   */
+
+  GrammarAnalysis(const Grammar& grammar, int start);
+
+  /**
+   * Predicate Methods: isReachable, isProductive
+   * --------------------------------------------
+   * isReachable returns true if and only if the nonterminal appears in
+   * some expansion of the start symbol.  isProductive returns true if and
+   * only if the nonterminal has at least one finite expansion.  A
+   * nonterminal that isn't productive loops forever no matter which
+   * productions are chosen.
+   */
+
+  bool isReachable(int id) const { return reachable[id]; }
+  bool isProductive(int id) const { return minLength[id] != kUnbounded; }
+
+  /**
+   * Methods: getMinLength, getProductionMinLength
+   * ---------------------------------------------
+   * Return the length of the shortest possible expansion of the
+   * specified nonterminal or production, or kUnbounded if it has none.
+   */
+
+  uint64_t getMinLength(int id) const { return minLength[id]; }
+  uint64_t getProductionMinLength(int production) const { return productionMinLength[production]; }
+
+  /**
+   * Method: getExpectedLength
+   * -------------------------
+   * Returns the average length of the specified nonterminal's expansion,
+   * or HUGE_VAL if the average is infinite (as it is for any grammar
+   * whose recursion is at least as likely to grow as to shrink).
+   */
+
+  double getExpectedLength(int id) const { return expectedLength[id]; }
+
+  /**
+   * Method: getTerminationProbability
+   * ---------------------------------
+   * Returns the probability that a random expansion of the specified
+   * nonterminal ever finishes.
+   */
+
+  double getTerminationProbability(int id) const { return terminationProbability[id]; }
+
+  /**
+   * Predicate Method: isPathological
+   * --------------------------------
+   * Returns true if and only if some reachable nonterminal is unproductive,
+   * might never finish, or has an infinite expected length.  Expanding a
+   * pathological grammar without a depth or length limit can run forever.
+   */
+
+  bool isPathological() const;
+
+  /**
+   * Method: print
+   * -------------
+   * Publishes a table with one row per nonterminal, followed by a
+   * warning for every problem that makes the grammar pathological.
+   */
+
+  void print(ostream& out) const;
+
+ private:
+  const Grammar& grammar;
+  int start;
+  vector<bool> reachable;
+  vector<uint64_t> minLength;
+  vector<uint64_t> productionMinLength;
+  vector<double> expectedLength;
+  vector<double> terminationProbability;
+
+  void findReachable();
+  void computeMinLengths();
+  void computeExpectedLengths(const vector<double>& probabilities);
+  void computeTerminationProbabilities(const vector<double>& probabilities);
+};
+
+#endif // ! __analysis__
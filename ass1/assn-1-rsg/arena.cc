@@ -0,0 +1,72 @@
+/**
+ * File: arena.cc
+ * --------------
+ * Provides the implementation of the Arena class's slow paths:
+ * starting new chunks and releasing them all.
+ */
+
+#include "arena.h"
+#include <stdlib.h>
+#include <new>
+
+const size_t Arena::kDefaultChunkSize;
+
+Arena::Arena(size_t chunkSize) : chunks(NULL), next(NULL), limit(NULL), chunkSize(chunkSize) {}
+
+Arena::Arena(Arena&& original) :
+  chunks(original.chunks), next(original.next), limit(original.limit), chunkSize(original.chunkSize)
+{
+  original.chunks = NULL;
+  original.next = original.limit = NULL;
+}
+
+Arena& Arena::operator=(Arena&& rhs)
+{
+  if (this == &rhs) return *this;
+  release();
+  chunks = rhs.chunks;
+  next = rhs.next;
+  limit = rhs.limit;
+  chunkSize = rhs.chunkSize;
+  rhs.chunks = NULL;
+  rhs.next = rhs.limit = NULL;
+  return *this;
+}
+
+Arena::~Arena()
+{
+  release();
+}
+
+/**
+ * Method: allocateChunk
+ * ---------------------
+ * Starts a new chunk big enough for the request (with room to spare
+ * for the header and any padding), makes it the current chunk, and
+ * carves the request out of it.  Whatever was left of the old chunk
+ * goes unused.
+ */
+
+void *Arena::allocateChunk(size_t bytes, size_t alignment)
+{
+  size_t needed = sizeof(Chunk) + alignment + bytes;
+  size_t size = chunkSize > needed ? chunkSize : needed;
+  Chunk *chunk = static_cast<Chunk *>(malloc(size));
+  if (chunk == NULL) throw bad_alloc();
+  chunk->previous = chunks;
+  chunks = chunk;
+  next = reinterpret_cast<char *>(chunk + 1);
+  limit = reinterpret_cast<char *>(chunk) + size;
+  chunkSize = size * 2;
+  return allocate(bytes, alignment);
+}
+
+void Arena::release()
+{
+  while (chunks != NULL) {
+    Chunk *previous = chunks->previous;
+    free(chunks);
+    chunks = previous;
+  }
+  next = limit = NULL;
+}
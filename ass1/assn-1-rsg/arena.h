@@ -0,0 +1,128 @@
+/**
+ * File: arena.h
+ * -------------
+ * Defines the Arena class, a bump allocator that backs everything
+ * read in from a single grammar file: the text of every word, the
+ * array of words making up each Production, and the array of
+ * Productions making up each Definition.  Allocation just advances a
+ * pointer through a large chunk of memory, so consecutive allocations
+ * sit side by side, and nothing is ever freed individually: the whole
+ * arena is released at once when it's destroyed.
+ *
+ * Only objects that need no destructor may live in an Arena, since
+ * none is ever called.  An Arena can be moved but never copied, so there
+ * is always exactly one owner responsible for releasing it.
+ */
+
+#ifndef __arena__
+#define __arena__
+
+#include <stddef.h>
+#include <string>
+#include <string_view>
+using namespace std;
+
+class Arena {
+
+ public:
+
+  static const size_t kDefaultChunkSize = 64 * 1024;
+
+  /**
+   * Constructor: Arena
+   * ------------------
+   * Constructs an empty Arena whose first chunk will hold at least
+   * the specified number of bytes.  Nothing is allocated until the first
+   * request.  When a grammar's size is known in advance, passing a good
+   * estimate means the whole grammar lands in a single chunk.
+   */
+
+  Arena(size_t chunkSize = kDefaultChunkSize);
+
+  /**
+   * Move Constructor and Assignment: Arena
+   * --------------------------------------
+   * Transfer every chunk to the new owner, leaving the original empty.
+   */
+
+  Arena(Arena&& original);
+  Arena& operator=(Arena&& rhs);
+
+  /**
+   * Destructor: ~Arena
+   * ------------------
+   * Releases every chunk, and with them everything ever allocated.
+   */
+
+  ~Arena();
+
+  /**
+   * Method: allocate
+   * ----------------
+   * Returns the address of the specified number of uninitialized
+   * bytes, aligned as specified.  When the current chunk is full, a new
+   * one at least twice as large is started, so the number of chunks
+   * grows only with the logarithm of the total.
+   */
+
+  void *allocate(size_t bytes, size_t alignment = alignof(max_align_t))
+  {
+    size_t padding = (alignment - reinterpret_cast<size_t>(next) % alignment) % alignment;
+    if (next == NULL || static_cast<size_t>(limit - next) < padding + bytes) return allocateChunk(bytes, alignment);
+    void *result = next + padding;
+    next += padding + bytes;
+    return result;
+  }
+
+  /**
+   * Method: allocateArray
+   * ---------------------
+   * Returns room for the specified number of objects of type T,
+   * which the caller is responsible for initializing.
+   */
+
+  template <typename T>
+  T *allocateArray(size_t count) { return static_cast<T *>(allocate(count * sizeof(T), alignof(T))); }
+
+  /**
+   * Method: copy
+   * ------------
+   * Copies the specified text into the Arena and returns a view of the
+   * copy, which remains valid for as long as the Arena does.
+   */
+
+  string_view copy(const char *text, size_t length)
+  {
+    char *copy = static_cast<char *>(allocate(length, 1));
+    char_traits<char>::copy(copy, text, length);
+    return string_view(copy, length);
+  }
+
+  string_view copy(const string& text) { return copy(text.data(), text.size()); }
+
+ private:
+
+  /**
+   * Every chunk opens with this header, which links it to the chunk
+   * allocated before it.  The memory handed out follows the header.
+   */
+
+  struct Chunk {
+    Chunk *previous;
+  };
+
+  Chunk *chunks;               // the most recently allocated chunk
+  char *next;                  // the first unused byte of that chunk
+  char *limit;                 // the end of that chunk
+  size_t chunkSize;            // the size of the next chunk to allocate
+
+  void *allocateChunk(size_t bytes, size_t alignment);
+  void release();
+
+  // marked as private so Arenas can't be copy constructed or copy assigned,
+  // since two copies would both free the same chunks.
+  Arena(const Arena& original);
+  Arena& operator=(const Arena& rhs);
+};
+
+#endif // ! __arena__
@@ -0,0 +1,360 @@
+/**
+ * File: bulk.cc
+ * -------------
+ * Provides the implementation of bulk sentence generation.  The
+ * sentences are numbered 0 through count - 1 and carved up into
+ * fixed-size blocks.  Worker threads claim blocks one at a time,
+ * gather every sentence in the block into a GatherWriter, and then
+ * write the block to the output file with a single writev call (or as
+ * few as it takes).  Each thread owns
+ * its RandomGenerator outright, so sampling never takes a lock, and the
+ * generator is keyed on the sentence number before every sentence, so
+ * the way blocks are divvied up among threads never changes the text.
+ *
+ * With --unique, each thread instead expands its block's sentences into
+ * a buffer of its own and hashes each one as it finishes.  Whether a
+ * sentence is new is decided when the block is flushed, under the lock
+ * that already serializes the writes, so the SentenceSet needs no
+ * locking of its own and the (much more expensive) expanding and hashing
+ * still happen in parallel.  Blocks keep being claimed until count
+ * sentences have been written.  In ordered mode, blocks are flushed in
+ * order, so the output is always the first count distinct sentences of
+ * what rsg would otherwise print.
+ *
+ * RSS items are built up as text, since each sentence has to be escaped
+ * for XML anyway.  Item i belongs to feed i % N, so each block is built
+ * as one chunk of text per feed, and each chunk is handed to its feed's
+ * file as a single piece.  Writes are still serialized by the same lock,
+ * and in ordered mode, every feed receives its items in increasing order.
+ */
+
+#include "bulk.h"
+#include "random.h"
+#include "expander.h"
+#include "derivations.h"
+#include "unique.h"
+#include "lengths.h"
+#include "feeds.h"
+#include <atomic>
+#include <limits.h>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+static const long kMaxRepeatsInARow = 1 << 20;
+
+/**
+ * Struct: BulkState
+ * -----------------
+ * Everything the worker threads share.  nextBlock is the only
+ * field touched without holding the lock; nextToWrite is the number
+ * of the block that's next in line to be written when the output
+ * is ordered.  Once stopped is true, every thread stops as soon as it
+ * notices; error explains why, unless the run simply finished early.
+ * seen is only present with --unique, which never runs out of blocks
+ * and instead stops once written reaches the count.  lengths is only
+ * present with --max-chars, and is computed once for every thread.
+ */
+
+struct BulkState {
+  const Grammar& grammar;
+  int start;
+  const BulkOptions& options;
+  const vector<int>& fds;
+  long blockCount;
+  atomic<long> nextBlock;
+  mutex lock;
+  condition_variable turn;
+  long nextToWrite;
+  bool stopped;
+  string error;
+  unique_ptr<SentenceSet> seen;
+  unique_ptr<LengthDistribution> lengths;
+  long written;
+  long repeatsInARow;
+
+  BulkState(const Grammar& grammar, const GrammarAnalysis& analysis, int start,
+	    const BulkOptions& options, const vector<int>& fds) :
+    grammar(grammar), start(start), options(options), fds(fds),
+    blockCount(options.unique ? LONG_MAX / kSentencesPerBlock :
+	       (options.count + kSentencesPerBlock - 1) / kSentencesPerBlock),
+    nextBlock(0), nextToWrite(0), stopped(false),
+    seen(options.unique ? new SentenceSet(options.uniqueMemory) : NULL),
+    lengths(options.maxChars != string::npos ? new LengthDistribution(grammar, analysis, options.maxChars) : NULL),
+    written(0), repeatsInARow(0) {}
+};
+
+/**
+ * Struct: BlockText
+ * -----------------
+ * A block's worth of sentences as --unique collects them: all of the
+ * text back to back, newlines and all, along with where each sentence
+ * ends and its hash.  If some sentence in the block hit a limit, failure
+ * explains which, and the sentences before it are all that's recorded.
+ * With --rss, items holds the block's items instead, one chunk per feed.
+ */
+
+struct BlockText {
+  string text;
+  vector<size_t> ends;
+  vector<uint64_t> hashes;
+  string failure;
+  vector<string> items;
+
+  void clear()
+  {
+    text.clear(); ends.clear(); hashes.clear(); failure.clear();
+    for (size_t i = 0; i < items.size(); i++) items[i].clear();
+  }
+};
+
+/**
+ * Function: stop
+ * --------------
+ * Records why the run is being stopped (keeping only the first reason,
+ * and an empty one if it's simply done), makes sure no more blocks get
+ * claimed, and wakes any thread waiting for its turn to write so that it
+ * can give up too.
+ */
+
+static void stop(BulkState& state, const string& reason)
+{
+  lock_guard<mutex> guard(state.lock);
+  if (!state.stopped) state.error = reason;
+  state.stopped = true;
+  state.nextBlock = state.blockCount;
+  state.turn.notify_all();
+}
+
+/**
+ * Function: keepNewSentences
+ * --------------------------
+ * Adds each of the block's sentences to the set of those already
+ * written, and appends the new ones to pieces, until count sentences
+ * have been written in all.  The caller must hold the lock.  Returns
+ * the reason the run can't go on, if there is one.
+ */
+
+static string keepNewSentences(BulkState& state, const BlockText& sentences, GatherWriter& pieces)
+{
+  pieces.clear();
+  size_t begin = 0;
+  for (size_t i = 0; i < sentences.ends.size() && state.written < state.options.count; i++) {
+    switch (state.seen->add(sentences.hashes[i])) {
+    case SentenceSet::kAdded:
+      pieces.append(sentences.text.data() + begin, sentences.ends[i] - begin);
+      state.written++;
+      state.repeatsInARow = 0;
+      break;
+    case SentenceSet::kRepeated:
+      if (++state.repeatsInARow == kMaxRepeatsInARow)
+	return "Gave up after " + to_string(kMaxRepeatsInARow) + " repeated sentences in a row, " +
+	  "with only " + to_string(state.written) + " distinct ones written.";
+      break;
+    case SentenceSet::kFull:
+      return "Remembering more than " + to_string(state.seen->getCapacity()) +
+	" distinct sentences would take more memory than --unique-memory allows.";
+    }
+    begin = sentences.ends[i];
+  }
+  if (state.written < state.options.count) return sentences.failure;
+  return "";
+}
+
+/**
+ * Function: writeItems
+ * --------------------
+ * Writes each feed's chunk of the block's items to that feed's file,
+ * using the supplied pieces to do it.
+ */
+
+static bool writeItems(BulkState& state, GatherWriter& pieces, const BlockText& sentences)
+{
+  for (size_t feed = 0; feed < state.fds.size(); feed++) {
+    pieces.clear();
+    pieces.append(sentences.items[feed].data(), sentences.items[feed].size());
+    if (!pieces.write(state.fds[feed])) return false;
+  }
+  return true;
+}
+
+/**
+ * Function: flushBlock
+ * --------------------
+ * Writes the specified block's pieces to the output file, or its items
+ * to their feeds' files.  When the
+ * output is ordered, the calling thread waits until every earlier block
+ * has been written.  Blocks are claimed in increasing order, so the block
+ * being waited on is always owned by some thread that's making progress,
+ * or else the run has been stopped.  With --unique, the pieces are
+ * first rebuilt from whichever of the block's sentences are new.
+ */
+
+static void flushBlock(BulkState& state, long block, GatherWriter& pieces, const BlockText& sentences)
+{
+  unique_lock<mutex> guard(state.lock);
+  if (state.options.ordered) {
+    while (state.nextToWrite != block && !state.stopped) state.turn.wait(guard);
+  }
+  if (state.stopped) return;
+
+  string reason;
+  if (state.seen) reason = keepNewSentences(state, sentences, pieces);
+  bool written = state.options.feedURLs != NULL ? writeItems(state, pieces, sentences) :
+    pieces.write(state.fds[0]);
+  state.nextToWrite++;
+  if (state.options.ordered) state.turn.notify_all();
+  bool done = state.seen && state.written == state.options.count;
+  guard.unlock();
+  if (!written) stop(state, "Failed to write all of the generated sentences.");
+  else if (!reason.empty() || done) stop(state, reason);
+}
+
+/**
+ * Function: describeLimit
+ * -----------------------
+ * Builds the message explaining which limit the specified sentence hit.
+ */
+
+static string describeLimit(long sentence, Expander::Outcome outcome)
+{
+  return "Sentence " + to_string(sentence) + " exceeded the maximum " +
+    (outcome == Expander::kTooDeep ? "depth" : "length") + ".";
+}
+
+/**
+ * Function: generateItems
+ * -----------------------
+ * Appends each of the RSS items numbered first through last - 1 to the
+ * end of its feed's string, one element per line.  Returns the reason
+ * the block can't be finished, if there is one.
+ */
+
+static string generateItems(BulkState& state, Expander& expander, UniformSampler *sampler,
+			    RandomGenerator& random, long first, long last, vector<string>& texts)
+{
+  string sentence;
+  for (long i = first; i < last; i++) {
+    const string& feedURL = (*state.options.feedURLs)[i % state.fds.size()];
+    string& text = texts[i % state.fds.size()];
+    for (int part = 0; part < 2; part++) {
+      long number = 2 * i + part;
+      random.setStream(state.options.seed, number);
+      if (sampler != NULL) {
+	if (!sampler->sample(state.start, state.options.words, random, sentence))
+	  return "There are no sentences with " + to_string(state.options.words) + " words to choose from.";
+      } else {
+	Expander::Outcome outcome = expander.expand(state.start, random, sentence);
+	if (outcome != Expander::kComplete) return describeLimit(number, outcome);
+      }
+      text += part == 0 ? "    <item>\n      <title>" : "      <description>";
+      appendEscapedXML(text, sentence);
+      text += part == 0 ? "</title>\n" : "</description>\n";
+    }
+    text += "      <link>";
+    appendEscapedXML(text, feedURL);
+    text += "#item-" + to_string(i) + "</link>\n    </item>\n";
+  }
+  return "";
+}
+
+/**
+ * Function: generateBlocks
+ * ------------------------
+ * The body of each worker thread: claims blocks until there are none
+ * left, gathering each block's sentences into the thread's own
+ * GatherWriter before flushing it.  The GatherWriter is reused from block
+ * to block, so its piece list stops growing after the first one.
+ * Each thread gets its own UniformSampler when sentences are drawn by
+ * length, since the counts are shared but the sampler's stack isn't.
+ * With --unique, a sentence that hits a limit only ends the run if it's
+ * reached before enough distinct sentences have been written, so the
+ * outcome doesn't depend on how far ahead the other threads have gotten.
+ */
+
+static void generateBlocks(BulkState& state)
+{
+  RandomGenerator random;
+  Expander expander(state.grammar);
+  expander.setMaxDepth(state.options.maxDepth);
+  expander.setMaxLength(state.options.maxLength);
+  if (state.lengths) expander.setMaxChars(*state.lengths);
+  unique_ptr<UniformSampler> sampler;
+  if (state.options.derivations != NULL) sampler.reset(new UniformSampler(*state.options.derivations));
+  GatherWriter pieces;
+  BlockText sentences;
+  if (state.options.feedURLs != NULL) sentences.items.resize(state.fds.size());
+  string sentence;
+  while (true) {
+    long block = state.nextBlock++;
+    if (block >= state.blockCount) return;
+    long first = block * kSentencesPerBlock;
+    long last = state.seen ? first + kSentencesPerBlock : min(first + kSentencesPerBlock, state.options.count);
+    pieces.clear();
+    sentences.clear();
+    if (state.options.feedURLs != NULL) {
+      string failure = generateItems(state, expander, sampler.get(), random, first, last, sentences.items);
+      if (!failure.empty()) {
+	stop(state, failure);
+	return;
+      }
+      flushBlock(state, block, pieces, sentences);
+      continue;
+    }
+
+    for (long i = first; i < last; i++) {
+      random.setStream(state.options.seed, i);
+      string failure;
+      if (sampler) {
+	bool sampled = state.seen ? sampler->sample(state.start, state.options.words, random, sentence) :
+	  sampler->sample(state.start, state.options.words, random, pieces);
+	if (!sampled)
+	  failure = "There are no sentences with " + to_string(state.options.words) + " words to choose from.";
+      } else {
+	Expander::Outcome outcome = state.seen ? expander.expand(state.start, random, sentence) :
+	  expander.expand(state.start, random, pieces);
+	if (outcome != Expander::kComplete) failure = describeLimit(i, outcome);
+      }
+
+      if (!state.seen) {
+	if (!failure.empty()) {
+	  stop(state, failure);
+	  return;
+	}
+	pieces.push_back('\n');
+      } else if (!failure.empty()) {
+	sentences.failure = failure;
+	break;
+      } else {
+	sentences.hashes.push_back(SentenceSet::hash(sentence.data(), sentence.size()));
+	sentences.text += sentence;
+	sentences.text.push_back('\n');
+	sentences.ends.push_back(sentences.text.size());
+      }
+    }
+
+    flushBlock(state, block, pieces, sentences);
+  }
+}
+
+bool generateBulk(const Grammar& grammar, const GrammarAnalysis& analysis, int start,
+		  const BulkOptions& options, int fd, string& error)
+{
+  return generateBulk(grammar, analysis, start, options, vector<int>(1, fd), error);
+}
+
+bool generateBulk(const Grammar& grammar, const GrammarAnalysis& analysis, int start,
+		  const BulkOptions& options, const vector<int>& fds, string& error)
+{
+  BulkState state(grammar, analysis, start, options, fds);
+  vector<thread> workers;
+  for (int i = 1; i < options.threads; i++)
+    workers.push_back(thread(generateBlocks, ref(state)));
+  generateBlocks(state); // the calling thread does its share too
+  for (size_t i = 0; i < workers.size(); i++)
+    workers[i].join();
+
+  error = state.error;
+  return error.empty();
+}
@@ -0,0 +1,117 @@
+/**
+ * File: bulk.h
+ * ------------
+ * Defines the interface for bulk sentence generation, where
+ * a large number of sentences are generated across several worker
+ * threads and written out one sentence per line.
+ */
+
+#ifndef __bulk__
+#define __bulk__
+
+#include "grammar.h"
+#include "expander.h"
+#include "analysis.h"
+#include "derivations.h"
+#include "unique.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+/**
+ * Struct: BulkOptions
+ * -------------------
+ * Bundles the knobs controlling a bulk run.  When ordered is true,
+ * the sentences are written in the order they were numbered, no matter
+ * which thread produced them.  When it's false, each thread flushes
+ * its buffer as soon as it's full, which avoids waiting on slower threads
+ * at the cost of a nondeterministic interleaving of blocks.  Sentence i
+ * is determined by the seed and i alone: with ordered output, the same
+ * seed always produces the same text, whatever the thread count.
+ * maxDepth, maxLength, and maxChars are handed to each thread's Expander.
+ * When derivations is non-NULL, the Expanders aren't used at all: every
+ * sentence is instead drawn uniformly from the derivations of <start>
+ * with exactly words words, using the supplied (shared) counts.
+ * When unique is true, sentences that repeat an earlier one are dropped
+ * and generation carries on until count distinct sentences have been
+ * written; the hashes that remember them get at most uniqueMemory bytes.
+ * When feedURLs is non-NULL, the output is a set of RSS feeds rather
+ * than lines of text (see feeds.h), and count is the number of items.
+ */
+
+struct BulkOptions {
+  long count;
+  int threads;
+  bool ordered;
+  uint64_t seed;
+  size_t maxDepth;
+  size_t maxLength;
+  size_t maxChars;
+  int words;
+  const DerivationCounter *derivations;
+  bool unique;
+  size_t uniqueMemory;
+  const vector<string> *feedURLs;
+
+  BulkOptions() : count(0), threads(1), ordered(true), seed(0),
+    maxDepth(Expander::kDefaultMaxDepth), maxLength(string::npos), maxChars(string::npos),
+    words(0), derivations(NULL), unique(false), uniqueMemory(SentenceSet::kDefaultMaxBytes),
+    feedURLs(NULL) {}
+};
+
+/**
+ * Constant: kSentencesPerBlock
+ * ----------------------------
+ * The number of sentences in each block a worker thread claims, gathers,
+ * and writes in one go.  A run that stops early has written whole blocks
+ * only, never part of one.
+ */
+
+static const long kSentencesPerBlock = 1024;
+
+/**
+ * Function: generateBulk
+ * ----------------------
+ * Generates options.count sentences from the specified nonterminal,
+ * using options.threads worker threads.  Each thread owns its own
+ * RandomGenerator and its own GatherWriter, and each GatherWriter is
+ * written straight to the supplied file descriptor a block of sentences
+ * at a time.
+ * Every sentence is generated from its own counter-based stream,
+ * keyed on options.seed and the sentence's number.  If any sentence
+ * exceeds the Expander limits, or the file can't be written, the whole
+ * run stops early.  With options.unique, the run also stops early if
+ * the grammar seems to have run out of new sentences, or if remembering
+ * them would take more than options.uniqueMemory bytes.
+ *
+ * @param grammar the compiled grammar, which is shared by all of the threads.
+ * @param analysis the grammar's analysis, used to keep sentences within maxChars.
+ * @param start the id of the nonterminal each sentence is expanded from.
+ * @param options the number of sentences, threads, and the flushing policy.
+ * @param fd the file descriptor receiving the sentences, one per line.
+ * @param error set to a description of what went wrong when the run stops early.
+ * @return true if and only if every sentence was written successfully.
+ */
+
+bool generateBulk(const Grammar& grammar, const GrammarAnalysis& analysis, int start,
+		  const BulkOptions& options, int fd, string& error);
+
+/**
+ * Function: generateBulk
+ * ----------------------
+ * Generates options.count RSS items, just as the version above
+ * generates sentences, and deals them out among the supplied file
+ * descriptors, one of which is opened for each of *options.feedURLs.
+ * Items are dealt out one at a time, in turn, so item i goes to
+ * fds[i % fds.size()], and every feed gets within one item of its
+ * share, whatever the count and however many threads there are.  Item i takes sentence 2i as its title and
+ * sentence 2i + 1 as its description, and links to its feed's URL with
+ * "#item-i" appended.  Only the items are written, so each feed's opening
+ * and closing tags are up to the caller.
+ */
+
+bool generateBulk(const Grammar& grammar, const GrammarAnalysis& analysis, int start,
+		  const BulkOptions& options, const vector<int>& fds, string& error);
+
+#endif // ! __bulk__
@@ -8,7 +8,8 @@
  */ 
  
 #include "definition.h"
-#include "random.h"
+#include <stdint.h>
+#include <new>
 
 /**
  * Constructor: Definition
@@ -19,21 +20,90 @@
  * constructor which also takes an ifstream reference.
  * The strong assumption is that the file reference is
  * poised to read the opening '{' as the very first character.
+ * The Productions are collected in a local vector until the '}'
+ * shows how many there are, and then copied into the Arena as one
+ * contiguous array.
  */
 
-Definition::Definition(ifstream& infile)
+Definition::Definition(ifstream& infile, Arena& arena) :
+  totalWeight(0), overweight(false), accept(NULL), alias(NULL)
 {
   string uselessText;
   getline(infile, uselessText, '{');
   infile >> nonterminal;
   getline(infile, uselessText); // stop character defaults to '\n'
 
+  vector<Production> found;
+  vector<string_view> scratch;
   while (infile.peek() != '}') {
-    Production possibleExpansion(infile);
-    possibleExpansions.push_back(possibleExpansion);
+    Production possibleExpansion(infile, arena, scratch);
+    found.push_back(possibleExpansion);
   }
   
   getline(infile, uselessText, '}');
+  expansionCount = found.size();
+  Production *placed = arena.allocateArray<Production>(expansionCount);
+  for (size_t i = 0; i < expansionCount; i++)
+    new (placed + i) Production(found[i]);
+  possibleExpansions = placed;
+  buildAliasTable(arena);
+}
+
+/**
+ * Method: buildAliasTable
+ * -----------------------
+ * Builds the alias table using Vose's method, but entirely in integers
+ * so the probabilities come out exact.  Production i starts with
+ * weight * n units of mass, and each of the n columns holds exactly
+ * totalWeight units.  Every column with too little mass of its own is
+ * topped off with mass from some column that has too much, and that
+ * donor becomes the column's alias.  Columns left over at the end are
+ * exactly full and always accept.  The finished table is placed in
+ * the Arena alongside the Productions.  Each weight is at most a million,
+ * but there can be any number of them, so a total that won't fit in 32
+ * bits just marks the Definition as overweight, for the loader to reject.
+ */
+
+void Definition::buildAliasTable(Arena& arena)
+{
+  size_t n = expansionCount;
+  uint64_t total = 0;
+  bool uniform = true;
+  for (size_t i = 0; i < n; i++) {
+    total += possibleExpansions[i].getWeight();
+    if (possibleExpansions[i].getWeight() != possibleExpansions[0].getWeight()) uniform = false;
+  }
+  
+  if (uniform) return;
+  if (total > UINT32_MAX) {
+    overweight = true;
+    return;
+  }
+  totalWeight = total;
+  unsigned int *thresholds = arena.allocateArray<unsigned int>(n);
+  int *aliases = arena.allocateArray<int>(n);
+  vector<uint64_t> mass(n);
+  vector<int> small, large;
+  for (size_t i = 0; i < n; i++) {
+    thresholds[i] = totalWeight;
+    aliases[i] = i;
+    mass[i] = static_cast<uint64_t>(possibleExpansions[i].getWeight()) * n;
+    if (mass[i] < total) small.push_back(i);
+    else large.push_back(i);
+  }
+  
+  while (!small.empty() && !large.empty()) {
+    int lacking = small.back(); small.pop_back();
+    int donor = large.back(); large.pop_back();
+    thresholds[lacking] = mass[lacking];
+    aliases[lacking] = donor;
+    mass[donor] -= total - mass[lacking];
+    if (mass[donor] < total) small.push_back(donor);
+    else large.push_back(donor);
+  }
+  
+  accept = thresholds;
+  alias = aliases;
 }
 
 /**
@@ -41,13 +111,14 @@ Definition::Definition(ifstream& infile)
  * ---------------------------
  * Returns a const reference to one of the
  * embedded Productions.  Relies on the
- * correct implementation of the RandomNumberGenerator
- * class, but is otherwise a no-brainer.
+ * correct implementation of the RandomGenerator
+ * class and the alias table, but is otherwise a no-brainer.
  */
 
-const Production& Definition::getRandomProduction() const
+const Production& Definition::getRandomProduction(RandomGenerator& random) const
 {
-  static RandomGenerator random; 
-  int randomIndex = random.getRandomInteger(0, possibleExpansions.size() - 1);
+  int randomIndex = random.getRandomInteger(0, expansionCount - 1);
+  if (totalWeight != 0 && random.getRandomBelow(totalWeight) >= accept[randomIndex])
+    randomIndex = alias[randomIndex];
   return possibleExpansions[randomIndex];
 }
@@ -7,15 +7,29 @@
  * Encapulates the data necessary to capture
  * the notion of a CFG Definition.  A Definition
  * is just a nonterminal paired with all of
- * it's possible expansions.
+ * it's possible expansions.  The expansions, and the
+ * alias table used to choose among them, live in the same
+ * Arena as their words, so a Definition is only good for as
+ * long as the Arena it was read into.
  */
 
 #include "production.h"
+#include "arena.h"
+#include "random.h"
 #include <vector>
 using namespace std;  
 
 class Definition {
   
+ public:
+  
+  /**
+   * Provides STL-like iterator access to the sequence of Productions
+   * making up a Definition instance.
+   */
+  
+  typedef const Production *const_iterator;
+  
  public:
   
   /**
@@ -29,13 +43,15 @@ class Definition {
    * requires its elements to have a default constructor.
    */
   
-  Definition() {}
+  Definition() : possibleExpansions(NULL), expansionCount(0), totalWeight(0), overweight(false),
+    accept(NULL), alias(NULL) {}
   
   /**
    * ifstream Constructor: Definition
    * --------------------------------
    * Constructs an instance of the Definition instance
-   * based on the contents of the specified ifstream.  The
+   * based on the contents of the specified ifstream, placing
+   * everything but the nonterminal in the specified Arena.  The
    * contents of the file must adhere to the following
    * textual representation:
    * 
@@ -58,9 +74,21 @@ class Definition {
    *               an open curly brace as the next character.  If not, then
    *               the implementation makes no guarantees as to how the
    *               constructor behaves.
+   * @param arena the Arena that holds the grammar's Productions.
    */
   
-  Definition(ifstream& infile);
+  Definition(ifstream& infile, Arena& arena);
+  
+  /**
+   * Move Constructor and Assignment: Definition
+   * -------------------------------------------
+   * Transfer the Definition to a new owner.  Definitions can only be
+   * moved, never copied, which is how readGrammar hands each one to the
+   * map without duplicating it.
+   */
+  
+  Definition(Definition&& original) = default;
+  Definition& operator=(Definition&& rhs) = default;
 
   /**
    * Method: getNonterminal
@@ -80,18 +108,74 @@ class Definition {
    * ---------------------------
    * Returns an immutable reference to one and
    * exactly one of the Definition's expansions.
-   * The Production is chosen at random.
+   * The Production is chosen at random using the
+   * caller's generator, so Definitions can be shared
+   * between threads that each own a RandomGenerator.
+   * Each Production is chosen with probability proportional
+   * to its weight, and the choice takes constant time no
+   * matter how many Productions there are.
    *
+   * @param random the generator used to make the choice.
    * @return an immutable reference to a randomly selected
    *         Production held by the Definition.  It is assumed
    *         that the Definition has at least one Production.
    */
   
-  const Production& getRandomProduction() const;
+  const Production& getRandomProduction(RandomGenerator& random) const;
+  
+  /**
+   * Iterators: begin, end
+   * ---------------------
+   * Returns a const_iterator to the first or the past-the-end
+   * Production, so that clients (the Grammar compiler, in particular)
+   * can walk over every possible expansion in the order they appeared
+   * in the grammar file.
+   */
+  
+  const_iterator begin() const { return possibleExpansions; }
+  const_iterator end() const { return possibleExpansions + expansionCount; }
+  
+  /**
+   * Methods: getTotalWeight, getAcceptThreshold, getAlias
+   * -----------------------------------------------------
+   * Expose the alias table built when the Definition was read.  If
+   * every Production has the same weight, getTotalWeight returns 0 and
+   * there is no table: a uniform choice is all that's needed.  Otherwise,
+   * a weighted choice is made by picking a column i uniformly and a number
+   * r uniformly from [0, getTotalWeight()).  If r is less than
+   * getAcceptThreshold(i), the result is Production i, and otherwise
+   * it's Production getAlias(i).
+   */
+  
+  unsigned int getTotalWeight() const { return totalWeight; }
+  unsigned int getAcceptThreshold(int i) const { return accept[i]; }
+  int getAlias(int i) const { return alias[i]; }
+
+  /**
+   * Predicate Method: isOverweight
+   * ------------------------------
+   * Returns true if and only if the weights of the Productions add up
+   * to more than 32 bits can hold.  Such a Definition has no alias table,
+   * and a grammar holding one is rejected rather than compiled.
+   */
+
+  bool isOverweight() const { return overweight; }
   
  private:
   string nonterminal;
-  vector<Production> possibleExpansions;
+  const Production *possibleExpansions;
+  size_t expansionCount;
+  unsigned int totalWeight;
+  bool overweight;
+  const unsigned int *accept;
+  const int *alias;
+  
+  void buildAliasTable(Arena& arena);
+  
+  // marked as private so Definitions can't be copy constructed or copy
+  // assigned; they're moved instead.
+  Definition(const Definition& original);
+  Definition& operator=(const Definition& rhs);
 };
 
 #endif // ! __definition__
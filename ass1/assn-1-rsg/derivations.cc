@@ -0,0 +1,371 @@
+/**
+ * File: derivations.cc
+ * --------------------
+ * Provides the implementation of the DerivationCounter and
+ * UniformSampler classes.  The counts come from the usual dynamic
+ * program over lengths: a production's symbols can split n words among
+ * themselves in many ways, and the number of derivations for each split
+ * is the product of each symbol's count.  Rather than redo that
+ * convolution every time, every production keeps a suffix table: the
+ * number of derivations of its symbols i through the end that produce
+ * exactly n words.  Entry 0 of that table is the production's own count,
+ * and the sampler walks the same table to split a length among symbols.
+ *
+ * Every count is carried twice, once as a saturating 64-bit integer
+ * (exact until it overflows) and once as an Approximate, a double with an
+ * exponent of its own alongside, since recursive grammars reach counts
+ * past the largest double within a few hundred words.  The sampler only
+ * consults the Approximates, and only ever compares counts that are parts
+ * of one total, so it scales each one to the total's exponent and draws
+ * with ordinary doubles.
+ */
+
+#include "derivations.h"
+
+const uint64_t DerivationCounter::kSaturated;
+const int DerivationCounter::kExponentStep;
+static const double kStepScale = 0x1p-500; // 2^-kExponentStep
+static const double kStepLimit = 0x1p500;  // 2^kExponentStep
+
+/**
+ * Function: normalize
+ * -------------------
+ * Moves a mantissa that has grown past 2^kExponentStep back under it.
+ * Mantissas below the limit multiply to less than its square, and add to
+ * less than twice it, so one step is always enough.  Scaling by a power
+ * of two is exact, so no precision is lost.
+ */
+
+static void normalize(DerivationCounter::Approximate& count)
+{
+  if (count.mantissa < kStepLimit || isinf(count.mantissa)) return;
+  count.mantissa *= kStepScale;
+  count.exponent += DerivationCounter::kExponentStep;
+}
+
+/**
+ * Methods: add, multiply, differs
+ * -------------------------------
+ * Combine two counts, saturating the exact half instead of wrapping
+ * around.  A zero count wins a multiplication outright, so an infinite
+ * count times zero is zero rather than NaN, and an infinite count wins
+ * an addition outright.  When two approximate counts being added are
+ * kExponentStep or more apart, the smaller is scaled down to match, and
+ * once they're two steps apart it's too small to make any difference.
+ * Counts only ever change by growing, so differs is how the sweeps tell
+ * they've converged.
+ */
+
+DerivationCounter::Count DerivationCounter::add(const Count& a, const Count& b)
+{
+  Count sum;
+  if (__builtin_add_overflow(a.exact, b.exact, &sum.exact)) sum.exact = kSaturated;
+  if (a.approximate.exponent == b.approximate.exponent) {
+    sum.approximate.mantissa = a.approximate.mantissa + b.approximate.mantissa;
+    sum.approximate.exponent = a.approximate.exponent;
+  } else {
+    const Approximate& larger = a.approximate.exponent > b.approximate.exponent ? a.approximate : b.approximate;
+    const Approximate& smaller = a.approximate.exponent > b.approximate.exponent ? b.approximate : a.approximate;
+    sum.approximate = larger;
+    if (isinf(smaller.mantissa)) sum.approximate = smaller;
+    else if (smaller.exponent + kExponentStep == larger.exponent) sum.approximate.mantissa += smaller.mantissa * kStepScale;
+  }
+  normalize(sum.approximate);
+  return sum;
+}
+
+DerivationCounter::Count DerivationCounter::multiply(const Count& a, const Count& b)
+{
+  Count product = { 0, { 0.0, 0 } };
+  if (a.exact == 0 || b.exact == 0) return product;
+  if (__builtin_mul_overflow(a.exact, b.exact, &product.exact)) product.exact = kSaturated;
+  product.approximate.mantissa = a.approximate.mantissa * b.approximate.mantissa;
+  product.approximate.exponent = a.approximate.exponent + b.approximate.exponent;
+  normalize(product.approximate);
+  return product;
+}
+
+bool DerivationCounter::differs(const Count& a, const Count& b)
+{
+  return a.exact != b.exact || a.approximate.mantissa != b.approximate.mantissa ||
+    a.approximate.exponent != b.approximate.exponent;
+}
+
+/**
+ * Method: convolve
+ * ----------------
+ * Returns the sum of a[taken] * b[words - taken] over every split of
+ * the words, which is where nearly all of the counting time goes.  It's
+ * the same as adding up the products with add and multiply, but the
+ * products aren't normalized, and neither is the running sum until the
+ * very end.  Mantissas under 2^kExponentStep multiply to less than
+ * 2^(2 * kExponentStep), and no more than kMaxWords + 1 of those add up
+ * to anything near the largest double, so there's nothing to overflow.
+ */
+
+DerivationCounter::Count DerivationCounter::convolve(const Count *a, const Count *b, int words)
+{
+  Count sum = { 0, { 0.0, 0 } };
+  for (int taken = 0; taken <= words; taken++) {
+    const Count& x = a[taken];
+    const Count& y = b[words - taken];
+    if (x.exact == 0 || y.exact == 0) continue;
+    uint64_t exact;
+    if (__builtin_mul_overflow(x.exact, y.exact, &exact) ||
+	__builtin_add_overflow(sum.exact, exact, &sum.exact)) sum.exact = kSaturated;
+    double mantissa = x.approximate.mantissa * y.approximate.mantissa;
+    int exponent = x.approximate.exponent + y.approximate.exponent;
+    if (exponent == sum.approximate.exponent) {
+      sum.approximate.mantissa += mantissa;
+    } else if (exponent + kExponentStep == sum.approximate.exponent) {
+      sum.approximate.mantissa += mantissa * kStepScale;
+    } else if (exponent < sum.approximate.exponent) {
+      if (isinf(mantissa)) sum.approximate.mantissa = mantissa;
+    } else {
+      while (sum.approximate.exponent < exponent) {
+	sum.approximate.mantissa *= kStepScale;
+	sum.approximate.exponent += kExponentStep;
+      }
+      sum.approximate.mantissa += mantissa;
+    }
+  }
+  while (sum.approximate.mantissa >= kStepLimit && !isinf(sum.approximate.mantissa)) {
+    sum.approximate.mantissa *= kStepScale;
+    sum.approximate.exponent += kExponentStep;
+  }
+  return sum;
+}
+
+/**
+ * Method: scale
+ * -------------
+ * Returns the specified approximate count as a plain double, in units of
+ * 2^exponent, which is meant to be that of a total the count is part of.
+ * Counts that are two or more steps smaller come out as zero.  Rounding
+ * can leave a part just past its total, and so one step larger.
+ */
+
+double DerivationCounter::scale(const Approximate& count, int exponent)
+{
+  if (count.exponent == exponent) return count.mantissa;
+  if (count.exponent + kExponentStep == exponent) return count.mantissa * kStepScale;
+  if (count.exponent == exponent + kExponentStep) return count.mantissa * kStepLimit;
+  return 0.0;
+}
+
+/**
+ * Constructor: DerivationCounter
+ * ------------------------------
+ * Fills in the tables one length at a time, shortest first.  A symbol
+ * can only take all n words of a production if every other symbol takes
+ * none, so the counts for length n depend on each other only through
+ * nonterminals that can derive the empty string.  Each length is swept
+ * until nothing changes, which takes at most one sweep per nonterminal
+ * plus one to notice.  If the counts are still climbing after that, some
+ * nonterminal can derive itself without emitting a word, which means it
+ * has infinitely many derivations of that length; whatever is still
+ * changing is marked infinite, and that is swept through everything
+ * that depends on it.
+ */
+
+DerivationCounter::DerivationCounter(const Grammar& grammar, int maxWords) :
+  grammar(grammar), maxWords(maxWords)
+{
+  int nonterminalCount = grammar.getNonterminalCount();
+  int productionCount = grammar.getProductionCount();
+  Count zero = { 0, { 0.0, 0 } };
+  Count one = { 1, { 1.0, 0 } };
+  counts.assign(static_cast<size_t>(nonterminalCount) * (maxWords + 1), zero);
+  firstSuffix.resize(productionCount);
+  size_t size = 0;
+  for (int p = 0; p < productionCount; p++) {
+    firstSuffix[p] = size;
+    size += static_cast<size_t>(grammar.endSymbols(p) - grammar.beginSymbols(p) + 1) * (maxWords + 1);
+  }
+  suffixes.assign(size, zero);
+  for (int p = 0; p < productionCount; p++)
+    suffixes[suffixIndex(p, grammar.endSymbols(p) - grammar.beginSymbols(p), 0)] = one;
+
+  for (int words = 0; words <= maxWords; words++) {
+    int rounds = 0;
+    while (sweep(words) && rounds <= nonterminalCount) rounds++;
+    if (rounds <= nonterminalCount) continue;
+
+    vector<Count> previous(nonterminalCount);
+    for (int id = 0; id < nonterminalCount; id++) previous[id] = counts[index(id, words)];
+    sweep(words);
+    Count infinite = { kSaturated, { HUGE_VAL, 0 } };
+    for (int id = 0; id < nonterminalCount; id++) {
+      if (differs(counts[index(id, words)], previous[id])) counts[index(id, words)] = infinite;
+    }
+    for (int round = 0; round <= nonterminalCount && sweep(words); round++) ;
+  }
+}
+
+/**
+ * Method: countSymbol
+ * -------------------
+ * Returns the number of derivations of a single symbol of the specified
+ * length.  A terminal always has exactly as many words as were joined
+ * to make it.
+ */
+
+DerivationCounter::Count DerivationCounter::countSymbol(Grammar::symbol s, int words) const
+{
+  if (Grammar::isNonterminal(s)) return counts[index(Grammar::indexOf(s), words)];
+  bool matches = words == grammar.getTerminalWordCount(Grammar::indexOf(s));
+  Count count = { matches ? 1u : 0u, { matches ? 1.0 : 0.0, 0 } };
+  return count;
+}
+
+/**
+ * Method: sweep
+ * -------------
+ * Recomputes the suffix tables and nonterminal counts for the specified
+ * length, given the current counts of that length and the final counts
+ * of every shorter one.  Returns true if any nonterminal's count changed.
+ */
+
+bool DerivationCounter::sweep(int words)
+{
+  bool changed = false;
+  for (int id = 0; id < grammar.getNonterminalCount(); id++) {
+    Count total = { 0, { 0.0, 0 } };
+    for (int p = grammar.beginProductions(id); p < grammar.endProductions(id); p++) {
+      const Grammar::symbol *symbols = grammar.beginSymbols(p);
+      for (int i = grammar.endSymbols(p) - symbols - 1; i >= 0; i--) {
+	Count sum = { 0, { 0.0, 0 } };
+	if (Grammar::isNonterminal(symbols[i])) {
+	  sum = convolve(&counts[index(Grammar::indexOf(symbols[i]), 0)], &suffixes[suffixIndex(p, i + 1, 0)], words);
+	} else {
+	  int length = grammar.getTerminalWordCount(Grammar::indexOf(symbols[i]));
+	  if (words >= length) sum = suffixes[suffixIndex(p, i + 1, words - length)];
+	}
+	suffixes[suffixIndex(p, i, words)] = sum;
+      }
+      total = add(total, suffixes[suffixIndex(p, 0, words)]);
+    }
+
+    if (differs(total, counts[index(id, words)])) {
+      counts[index(id, words)] = total;
+      changed = true;
+    }
+  }
+
+  return changed;
+}
+
+/**
+ * Methods: sample, sampleInto
+ * ---------------------------
+ * Pending symbols and the number of words each must produce wait on an
+ * explicit stack, just as they do in the Expander, so deep derivations
+ * can't overflow the call stack.  Like the Expander, the loop only
+ * ever appends, so it serves both strings and GatherWriters.
+ */
+
+bool UniformSampler::sample(int start, int words, RandomGenerator& random, string& sentence)
+{
+  sentence.clear();
+  return sampleInto(start, words, random, sentence);
+}
+
+bool UniformSampler::sample(int start, int words, RandomGenerator& random, GatherWriter& pieces)
+{
+  return sampleInto(start, words, random, pieces);
+}
+
+template <class Text>
+bool UniformSampler::sampleInto(int start, int words, RandomGenerator& random, Text& text)
+{
+  if (words < 0 || words > counter.maxWords) return false;
+
+  bool first = true;
+  stack.clear();
+  Pending root = { start | Grammar::kNonterminalTag, words };
+  stack.push_back(root);
+  while (!stack.empty()) {
+    Pending pending = stack.back();
+    stack.pop_back();
+    if (Grammar::isNonterminal(pending.s)) {
+      if (!expand(Grammar::indexOf(pending.s), pending.words, random)) return false;
+    } else {
+      int index = Grammar::indexOf(pending.s);
+      if (!first) text.push_back(' ');
+      text.append(counter.grammar.getTerminal(index), counter.grammar.getTerminalLength(index));
+      first = false;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * Method: expand
+ * --------------
+ * Chooses one of the nonterminal's productions with probability
+ * proportional to its number of derivations of the given length, then
+ * decides how many words each of its symbols produces, left to right,
+ * with probability proportional to the number of derivations that are
+ * consistent with that choice.  The symbols are pushed in reverse so they
+ * come off the stack in order.  Rounding can leave the random target just
+ * past the last candidate, in which case the last viable one is taken.
+ *
+ * Every candidate's count is scaled to the exponent of the total it's
+ * part of before it's compared, so the draw itself only needs doubles.
+ * A count that's zero or infinite can't be drawn in proportion to, so
+ * if the total is either one, nothing is chosen and false is returned;
+ * candidates that are either one are passed over.
+ */
+
+bool UniformSampler::expand(int id, int words, RandomGenerator& random)
+{
+  const Grammar& grammar = counter.grammar;
+  DerivationCounter::Approximate total = counter.getApproximateCount(id, words);
+  if (total.mantissa == 0 || isinf(total.mantissa)) return false;
+  double target = random.getRandomFraction() * total.mantissa;
+  int production = -1;
+  for (int p = grammar.beginProductions(id); p < grammar.endProductions(id); p++) {
+    double count = DerivationCounter::scale(counter.suffixes[counter.suffixIndex(p, 0, words)].approximate,
+					    total.exponent);
+    if (count == 0 || isinf(count)) continue;
+    production = p;
+    if (target < count) break;
+    target -= count;
+  }
+  if (production == -1) return false;
+
+  split.clear();
+  const Grammar::symbol *symbols = grammar.beginSymbols(production);
+  int length = grammar.endSymbols(production) - symbols;
+  int remaining = words;
+  for (int i = 0; i < length; i++) {
+    int taken = 0;
+    if (!Grammar::isNonterminal(symbols[i])) {
+      taken = grammar.getTerminalWordCount(Grammar::indexOf(symbols[i]));
+    } else {
+      DerivationCounter::Approximate rest = counter.suffixes[counter.suffixIndex(production, i, remaining)].approximate;
+      if (rest.mantissa == 0 || isinf(rest.mantissa)) return false;
+      target = random.getRandomFraction() * rest.mantissa;
+      taken = -1;
+      for (int candidate = 0; candidate <= remaining; candidate++) {
+	DerivationCounter::Count product =
+	  DerivationCounter::multiply(counter.countSymbol(symbols[i], candidate),
+				      counter.suffixes[counter.suffixIndex(production, i + 1, remaining - candidate)]);
+	double count = DerivationCounter::scale(product.approximate, rest.exponent);
+	if (count == 0 || isinf(count)) continue;
+	taken = candidate;
+	if (target < count) break;
+	target -= count;
+      }
+      if (taken == -1) return false;
+    }
+    Pending pending = { symbols[i], taken };
+    split.push_back(pending);
+    remaining -= taken;
+  }
+
+  for (int i = length - 1; i >= 0; i--)
+    stack.push_back(split[i]);
+  return true;
+}
@@ -0,0 +1,185 @@
+/**
+ * File: derivations.h
+ * -------------------
+ * Defines the DerivationCounter class, which counts how many distinct
+ * derivations of each nonterminal produce exactly n words, for every n
+ * up to some bound, and the UniformSampler class, which uses those counts
+ * to draw a derivation of a chosen length uniformly at random.
+ *
+ * The Expander picks each production independently, so short, shallow
+ * derivations are far more likely than long ones.  Sampling by count
+ * instead gives every derivation of the chosen length the same chance.
+ * For an unambiguous grammar (one where no sentence has two derivations),
+ * that's the same as choosing uniformly among the sentences themselves.
+ * Weights are ignored here: every derivation counts once.
+ */
+
+#ifndef __derivations__
+#define __derivations__
+
+#include "grammar.h"
+#include "random.h"
+#include "gather.h"
+#include <math.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+class DerivationCounter {
+
+ public:
+
+  static const uint64_t kSaturated = UINT64_MAX;
+  static const int kMaxWords = 10000;
+
+  /**
+   * Constructor: DerivationCounter
+   * ------------------------------
+   * Counts the derivations of every nonterminal of length 0 through
+   * maxWords.  The work is all done here, once, and the resulting tables
+   * are read-only, so a single DerivationCounter can be shared by any
+   * number of threads.
+   *
+   * @param grammar the compiled grammar, which must outlive the counter.
+   * @param maxWords the longest length of interest, measured in words.
+   */
+
+  DerivationCounter(const Grammar& grammar, int maxWords);
+
+  int getMaxWords() const { return maxWords; }
+
+  /**
+   * Method: getCount
+   * ----------------
+   * Returns the exact number of derivations of the specified nonterminal
+   * that produce exactly the specified number of words, or kSaturated if
+   * the number is too large to fit in 64 bits (or is infinite, which only
+   * happens when a nonterminal can derive itself without emitting words).
+   */
+
+  uint64_t getCount(int id, int words) const { return counts[index(id, words)].exact; }
+
+  /**
+   * Struct: Approximate
+   * -------------------
+   * A count far too large for a double: it's worth mantissa * 2^exponent.
+   * The exponent is always a nonnegative multiple of kExponentStep, and
+   * is only ever nonzero when the mantissa is at least 1, and the mantissa
+   * is kept below 2^kExponentStep, so each count has exactly one form.
+   * The mantissa carries about sixteen digits, just as a double would.
+   * An infinite count has an infinite mantissa.
+   */
+
+  struct Approximate {
+    double mantissa;
+    int exponent;
+  };
+
+  static const int kExponentStep = 500;
+
+  /**
+   * Methods: getApproximateCount, isInfinite
+   * ----------------------------------------
+   * getApproximateCount returns the same count as getCount, approximately,
+   * and stays accurate well past the point where getCount saturates,
+   * through kMaxWords words and beyond.  isInfinite tells whether the
+   * count is truly infinite, which a count that's merely huge never is.
+   */
+
+  Approximate getApproximateCount(int id, int words) const { return counts[index(id, words)].approximate; }
+  bool isInfinite(int id, int words) const { return isinf(counts[index(id, words)].approximate.mantissa); }
+
+  /**
+   * Static Method: getLog10
+   * -----------------------
+   * Returns the base-ten logarithm of the specified count, which is
+   * -HUGE_VAL for zero and HUGE_VAL for infinity.
+   */
+
+  static double getLog10(const Approximate& count)
+  {
+    return log10(count.mantissa) + count.exponent * M_LN2 / M_LN10;
+  }
+
+ private:
+  struct Count {
+    uint64_t exact;
+    Approximate approximate;
+  };
+
+  friend class UniformSampler;
+
+  const Grammar& grammar;
+  int maxWords;
+  vector<Count> counts;                // (id, words) -> derivations of that nonterminal
+  vector<size_t> firstSuffix;          // production index -> suffix table
+  vector<Count> suffixes;              // (production, i, words) -> derivations of symbols i onward
+
+  size_t index(int id, int words) const { return static_cast<size_t>(id) * (maxWords + 1) + words; }
+  size_t suffixIndex(int production, int i, int words) const
+  {
+    return firstSuffix[production] + static_cast<size_t>(i) * (maxWords + 1) + words;
+  }
+  static Count add(const Count& a, const Count& b);
+  static Count multiply(const Count& a, const Count& b);
+  static bool differs(const Count& a, const Count& b);
+  static Count convolve(const Count *a, const Count *b, int words);
+  static double scale(const Approximate& count, int exponent);
+  Count countSymbol(Grammar::symbol s, int words) const;
+  bool sweep(int words);
+};
+
+class UniformSampler {
+
+ public:
+
+  /**
+   * Constructor: UniformSampler
+   * ---------------------------
+   * Constructs a sampler that draws on the specified counter's tables.
+   * Each thread should own its own UniformSampler, since the sampler
+   * keeps scratch space that's reused from one sentence to the next.
+   */
+
+  UniformSampler(const DerivationCounter& counter) : counter(counter) {}
+
+  /**
+   * Method: sample
+   * --------------
+   * Replaces the contents of the supplied string with a sentence of
+   * exactly the specified number of words, chosen uniformly at random
+   * from all derivations of the specified nonterminal with that length.
+   *
+   * @return true if and only if the sentence was generated.  It fails if
+   *         there are no such derivations, or infinitely many of them, or
+   *         if the length is beyond the counter's bound.
+   */
+
+  bool sample(int start, int words, RandomGenerator& random, string& sentence);
+
+  /**
+   * Method: sample
+   * --------------
+   * Samples exactly as above, but appends the sentence to the supplied
+   * GatherWriter as pieces of the Grammar's string pool.
+   */
+
+  bool sample(int start, int words, RandomGenerator& random, GatherWriter& pieces);
+
+ private:
+  struct Pending {
+    Grammar::symbol s;
+    int words;
+  };
+
+  const DerivationCounter& counter;
+  vector<Pending> stack;
+  vector<Pending> split;
+
+  template <class Text>
+  bool sampleInto(int start, int words, RandomGenerator& random, Text& text);
+  bool expand(int id, int words, RandomGenerator& random);
+};
+
+#endif // ! __derivations__
@@ -0,0 +1,218 @@
+/**
+ * File: expander.cc
+ * -----------------
+ * Provides the implementation of the Expander class.  Each frame on
+ * the stack is the unexpanded remainder of some production, and the
+ * main loop repeatedly pulls the next symbol off the current frame:
+ * terminals are appended to the sentence, and nonterminals set aside
+ * what's left of the current frame and start in on whichever of their
+ * productions is chosen.
+ */
+
+#include "expander.h"
+
+static const size_t kInitialStackCapacity = 64;
+
+Expander::Expander(const Grammar& grammar) :
+  grammar(grammar), maxDepth(kDefaultMaxDepth), maxLength(string::npos), lengths(NULL)
+{
+  stack.reserve(kInitialStackCapacity);
+}
+
+void Expander::setMaxChars(const LengthDistribution& lengths)
+{
+  this->lengths = &lengths;
+}
+
+/**
+ * Methods: expand
+ * ---------------
+ * Both overloads hand off to the same templated loop, one for each
+ * mode.  Only the string version starts from scratch.
+ */
+
+Expander::Outcome Expander::expand(int start, RandomGenerator& random, string& sentence)
+{
+  sentence.clear();
+  if (lengths != NULL) return expandWithinBudget(start, random, sentence);
+  return expandInto(start, random, sentence);
+}
+
+Expander::Outcome Expander::expand(int start, RandomGenerator& random, GatherWriter& pieces)
+{
+  if (lengths != NULL) return expandWithinBudget(start, random, pieces);
+  return expandInto(start, random, pieces);
+}
+
+/**
+ * Method: expandInto
+ * ------------------
+ * The frame currently being expanded is kept in locals rather
+ * than on the stack, and it's only pushed when a nonterminal
+ * interrupts it partway through.  When the nonterminal is the last
+ * symbol in the frame, the frame is finished, so nothing is pushed at
+ * all.  That keeps recursion through the right-most symbol
+ * (<start> -> ... <start>) at a constant depth.  A leaf nonterminal
+ * never gets a frame: its production's terminal is emitted on the spot,
+ * though it still counts toward the depth limit, exactly as if it had.  Text is written with
+ * nothing but append and push_back, so the same loop serves strings and GatherWriters;
+ * written counts what this sentence has added so far.
+ */
+
+template <class Text>
+Expander::Outcome Expander::expandInto(int start, RandomGenerator& random, Text& text)
+{
+  size_t written = 0;
+  stack.clear();
+  int production = grammar.chooseProduction(start, random);
+  const Grammar::symbol *next = grammar.beginSymbols(production);
+  const Grammar::symbol *end = grammar.endSymbols(production);
+
+  while (true) {
+    if (next == end) {
+      if (stack.empty()) return kComplete;
+      next = stack.back().next;
+      end = stack.back().end;
+      stack.pop_back();
+      continue;
+    }
+
+    Grammar::symbol s = *next++;
+    int index = Grammar::indexOf(s);
+    if (Grammar::isNonterminal(s)) {
+      if (next != end && stack.size() + 1 >= maxDepth) return kTooDeep;
+      production = grammar.chooseProduction(index, random);
+      if (!grammar.isLeaf(index)) {
+	if (next != end) {
+	  Frame rest = { next, end };
+	  stack.push_back(rest);
+	}
+	next = grammar.beginSymbols(production);
+	end = grammar.endSymbols(production);
+	continue;
+      }
+      if (grammar.beginSymbols(production) == grammar.endSymbols(production)) continue;
+      index = Grammar::indexOf(*grammar.beginSymbols(production));
+    }
+
+    size_t length = grammar.getTerminalLength(index);
+    size_t separator = written == 0 ? 0 : 1;
+    if (written + separator + length > maxLength) return kTooLong;
+    if (separator) text.push_back(' ');
+    text.append(grammar.getTerminal(index), length);
+    written += separator + length;
+  }
+}
+
+/**
+ * Method: expandWithinBudget
+ * --------------------------
+ * Draws the sentence's length from the lengths that fit, in proportion
+ * to their probabilities, and then expands <start> to exactly that
+ * length.  Pending symbols wait on their own stack, each with the length
+ * it has to produce, just as they do in the UniformSampler, and it's that
+ * stack the depth limit applies to.  Rounding can leave the random target
+ * just past the last candidate, in which case the last viable one is taken.
+ */
+
+template <class Text>
+Expander::Outcome Expander::expandWithinBudget(int start, RandomGenerator& random, Text& text)
+{
+  double total = 0.0;
+  for (size_t length = 0; length <= lengths->maxLength; length++)
+    total += lengths->getProbability(start, length);
+  if (total == 0) return kTooLong;
+  double target = random.getRandomFraction() * total;
+  size_t chosen = 0;
+  for (size_t length = 0; length <= lengths->maxLength; length++) {
+    double probability = lengths->getProbability(start, length);
+    if (probability == 0) continue;
+    chosen = length;
+    if (target < probability) break;
+    target -= probability;
+  }
+
+  size_t written = 0;
+  pending.clear();
+  Pending root = { start | Grammar::kNonterminalTag, chosen };
+  pending.push_back(root);
+  while (!pending.empty()) {
+    Pending next = pending.back();
+    pending.pop_back();
+    int index = Grammar::indexOf(next.s);
+    if (Grammar::isNonterminal(next.s)) {
+      if (!expandToLength(index, next.length, random)) return kTooLong;
+      if (pending.size() > maxDepth) return kTooDeep;
+      continue;
+    }
+
+    size_t length = grammar.getTerminalLength(index);
+    size_t separator = written == 0 ? 0 : 1;
+    if (written + separator + length > maxLength) return kTooLong;
+    if (separator) text.push_back(' ');
+    text.append(grammar.getTerminal(index), length);
+    written += separator + length;
+  }
+  return kComplete;
+}
+
+/**
+ * Method: expandToLength
+ * ----------------------
+ * Chooses one of the nonterminal's productions with probability
+ * proportional to its chance of producing exactly the specified length,
+ * then decides how much of the length each of its symbols produces, left
+ * to right, in proportion to the chance of that split, and pushes the
+ * symbols in reverse so they come off the stack in order.  Returns false
+ * if the length has no chance at all, which can only happen if the
+ * probabilities underflowed.
+ */
+
+bool Expander::expandToLength(int id, size_t length, RandomGenerator& random)
+{
+  const LengthDistribution& table = *lengths;
+  double total = table.getProbability(id, length);
+  if (total == 0) return false;
+  double target = random.getRandomFraction() * total;
+  int production = -1;
+  for (int p = grammar.beginProductions(id); p < grammar.endProductions(id); p++) {
+    double probability = table.weights[p] * table.suffixes[table.suffixIndex(p, 0, length)];
+    if (probability == 0) continue;
+    production = p;
+    if (target < probability) break;
+    target -= probability;
+  }
+  if (production == -1) return false;
+
+  split.clear();
+  const Grammar::symbol *symbols = grammar.beginSymbols(production);
+  int count = grammar.endSymbols(production) - symbols;
+  size_t remaining = length;
+  for (int i = 0; i < count; i++) {
+    size_t taken = table.getSymbolMinLength(symbols[i]);
+    if (Grammar::isNonterminal(symbols[i])) {
+      double rest = table.suffixes[table.suffixIndex(production, i, remaining)];
+      if (rest == 0) return false;
+      target = random.getRandomFraction() * rest;
+      const double *symbol = &table.probabilities[table.index(Grammar::indexOf(symbols[i]), 0)];
+      const double *following = &table.suffixes[table.suffixIndex(production, i + 1, 0)];
+      size_t viable = remaining + 1;
+      for (size_t candidate = taken; candidate <= remaining; candidate++) {
+	double probability = symbol[candidate] * following[remaining - candidate];
+	if (probability == 0) continue;
+	viable = candidate;
+	if (target < probability) break;
+	target -= probability;
+      }
+      if (viable > remaining) return false;
+      taken = viable;
+    }
+    Pending part = { symbols[i], taken };
+    split.push_back(part);
+    remaining -= taken;
+  }
+
+  for (int i = count - 1; i >= 0; i--)
+    pending.push_back(split[i]);
+  return true;
+}
@@ -0,0 +1,138 @@
+/**
+ * File: expander.h
+ * ----------------
+ * Defines the Expander class, which turns a compiled Grammar into
+ * random sentences without recursing.  Pending symbols live on an
+ * explicit stack owned by the Expander, so a single Expander can be
+ * reused for sentence after sentence without allocating, and grammars
+ * that nest deeply can't overflow the call stack.
+ */
+
+#ifndef __expander__
+#define __expander__
+
+#include "grammar.h"
+#include "lengths.h"
+#include "random.h"
+#include "gather.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+class Expander {
+
+ public:
+
+  /**
+   * Type: Outcome
+   * -------------
+   * Describes how an expansion ended.  Anything other than kComplete
+   * means a limit was hit and the expansion was abandoned partway through.
+   */
+
+  enum Outcome { kComplete, kTooDeep, kTooLong };
+
+  static const size_t kDefaultMaxDepth = 100000;
+
+  /**
+   * Constructor: Expander
+   * ---------------------
+   * Constructs an Expander that draws from the specified Grammar,
+   * which must outlive it.  The depth limit starts out at
+   * kDefaultMaxDepth and the length is unlimited.
+   */
+
+  Expander(const Grammar& grammar);
+
+  /**
+   * Methods: setMaxDepth, setMaxLength
+   * ----------------------------------
+   * Bound the number of nonterminals being expanded at once and the
+   * number of characters in the sentence.  An expansion that would
+   * exceed either one stops right away and reports kTooDeep or kTooLong.
+   * A right-most nonterminal replaces the production it ends rather than
+   * nesting inside it, so right-recursive grammars don't deepen the stack.
+   */
+
+  void setMaxDepth(size_t depth) { maxDepth = depth; }
+  void setMaxLength(size_t length) { maxLength = length; }
+
+  /**
+   * Method: setMaxChars
+   * -------------------
+   * Puts the Expander into bounded mode, where every sentence is made
+   * to fit in the number of characters the specified LengthDistribution
+   * was computed for, rather than abandoned when it runs over.  Sentences
+   * come out exactly as likely as they would without the budget, except
+   * that the ones that don't fit are never chosen: the sentence's length
+   * is drawn first, from the lengths that fit, and then every production
+   * and every split of a production's length among its symbols is drawn
+   * in proportion to its probability of producing exactly that length.
+   * The distribution must outlive the Expander (or the next call).
+   */
+
+  void setMaxChars(const LengthDistribution& lengths);
+
+  /**
+   * Method: expand
+   * --------------
+   * Expands the specified nonterminal into a random sentence, replacing
+   * the contents of the supplied string.  Terminals are separated by
+   * single spaces, and nothing is placed before the very first one, so
+   * the caller decides how sentences are framed.  Because the string is
+   * reused, repeated calls stop allocating once the string's capacity
+   * is large enough.  If a limit is hit, the string holds whatever was
+   * generated up to that point.  In bounded mode, the expansion only
+   * comes up short (with kTooLong) if no sentence of the start symbol
+   * fits, or if the ones that do are too unlikely for a double to hold.
+   *
+   * @param start the id of the nonterminal to expand, usually <start>.
+   * @param random the random generator used to choose each production.
+   * @param sentence the string that receives the generated text.
+   * @return kComplete, or the limit that cut the expansion short.
+   */
+
+  Outcome expand(int start, RandomGenerator& random, string& sentence);
+
+  /**
+   * Method: expand
+   * --------------
+   * Expands the specified nonterminal exactly as above, except that the
+   * sentence is appended to the supplied GatherWriter as pieces of the
+   * Grammar's string pool rather than copied.  Whatever was already
+   * collected is left alone, so many sentences can be gathered up and
+   * written at once.  If a limit is hit, the pieces of the partial
+   * sentence are left at the end.
+   */
+
+  Outcome expand(int start, RandomGenerator& random, GatherWriter& pieces);
+
+ private:
+  struct Frame {
+    const Grammar::symbol *next;
+    const Grammar::symbol *end;
+  };
+
+  struct Pending {
+    Grammar::symbol s;
+    size_t length;
+  };
+
+  const Grammar& grammar;
+  vector<Frame> stack;
+  size_t maxDepth;
+  size_t maxLength;
+  const LengthDistribution *lengths;
+  vector<Pending> pending;             // bounded mode's stack
+  vector<Pending> split;
+
+  template <class Text>
+  Outcome expandInto(int start, RandomGenerator& random, Text& text);
+  template <class Text>
+  Outcome expandWithinBudget(int start, RandomGenerator& random, Text& text);
+  bool expandToLength(int id, size_t length, RandomGenerator& random);
+};
+
+#endif // ! __expander__
@@ -0,0 +1,125 @@
+/**
+ * File: feeds.cc
+ * --------------
+ * Provides the implementation of RSS feed generation.  Every feed
+ * is opened, given its channel header, and then handed to generateBulk
+ * along with all the others, so the items themselves are generated in
+ * parallel and streamed into the files a block at a time.  Once they're
+ * all written, each feed gets its closing tags, and the feeds list is
+ * written last, so an indexer never sees a list naming unfinished feeds.
+ */
+
+#include "feeds.h"
+#include "gather.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char *const kFeedsListName = "feeds.txt";
+static const char *const kFileScheme = "file://";
+
+void appendEscapedXML(string& out, const string& text)
+{
+  const char *chars = text.c_str();
+  size_t begin = 0;
+  while (true) {
+    size_t special = begin + strcspn(chars + begin, "&<>\""); // glibc's is far faster than find_first_of
+    out.append(chars + begin, special - begin);
+    if (special == text.size()) return;
+    switch (chars[special]) {
+      case '&': out += "&amp;"; break;
+      case '<': out += "&lt;"; break;
+      case '>': out += "&gt;"; break;
+      case '"': out += "&quot;"; break;
+      default: out += '\0'; break; // an embedded '\0', which strcspn stops at too
+    }
+    begin = special + 1;
+  }
+}
+
+/**
+ * Function: writeText
+ * -------------------
+ * Writes all of the specified text to the file descriptor, returning
+ * true if and only if every byte made it.
+ */
+
+static bool writeText(int fd, const string& text)
+{
+  GatherWriter pieces;
+  pieces.append(text.data(), text.size());
+  return pieces.write(fd);
+}
+
+/**
+ * Function: getFeedTitle
+ * ----------------------
+ * Returns the title of the specified feed.  The feeds list uses the
+ * same titles, and ass4 takes everything up to the first ':' of each
+ * line as the title, so there mustn't be any others.
+ */
+
+static string getFeedTitle(const string& name, int feed)
+{
+  string title = name + " " + to_string(feed);
+  for (size_t i = 0; i < title.size(); i++)
+    if (title[i] == ':') title[i] = '-';
+  return title;
+}
+
+bool generateFeeds(const Grammar& grammar, const GrammarAnalysis& analysis, int start,
+		   const BulkOptions& options, const string& directory, int feedCount,
+		   const string& name, string& error)
+{
+  if (mkdir(directory.c_str(), 0755) == -1 && errno != EEXIST) {
+    error = "Failed to create the directory named \"" + directory + "\".";
+    return false;
+  }
+
+  vector<string> urls;
+  vector<int> fds;
+  for (int feed = 0; feed < feedCount && error.empty(); feed++) {
+    string path = directory + "/feed-" + to_string(feed) + ".xml";
+    urls.push_back(kFileScheme + path);
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+      error = "Failed to open the file named \"" + path + "\" for writing.";
+      break;
+    }
+    fds.push_back(fd);
+
+    string header = "<?xml version=\"1.0\" encoding=\"utf-8\" ?>\n<rss version=\"2.0\">\n  <channel>\n    <title>";
+    appendEscapedXML(header, getFeedTitle(name, feed));
+    header += "</title>\n    <link>";
+    appendEscapedXML(header, urls.back());
+    header += "</link>\n    <description>Sentences generated by rsg from ";
+    appendEscapedXML(header, name);
+    header += ".</description>\n";
+    if (!writeText(fd, header)) error = "Failed to write the feed named \"" + path + "\".";
+  }
+
+  if (error.empty()) {
+    BulkOptions feedOptions = options;
+    feedOptions.feedURLs = &urls;
+    generateBulk(grammar, analysis, start, feedOptions, fds, error);
+  }
+
+  for (size_t feed = 0; feed < fds.size(); feed++) {
+    bool written = !error.empty() || writeText(fds[feed], "  </channel>\n</rss>\n");
+    if ((close(fds[feed]) == -1 || !written) && error.empty())
+      error = "Failed to write the feed named \"" + urls[feed].substr(strlen(kFileScheme)) + "\".";
+  }
+  if (!error.empty()) return false;
+
+  string list;
+  for (int feed = 0; feed < feedCount; feed++)
+    list += getFeedTitle(name, feed) + ": " + urls[feed] + "\n";
+  string listPath = directory + "/" + kFeedsListName;
+  int fd = open(listPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  bool written = fd != -1 && writeText(fd, list);
+  if (fd != -1 && close(fd) == -1) written = false;
+  if (!written) error = "Failed to write the feeds list named \"" + listPath + "\".";
+  return written;
+}
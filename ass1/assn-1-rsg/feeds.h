@@ -0,0 +1,56 @@
+/**
+ * File: feeds.h
+ * -------------
+ * Defines the interface for writing generated sentences as a set of
+ * RSS feeds, which is what rsg --rss does to build synthetic news for
+ * the RSS news search engine (ass4) to index.  Each feed is an RSS 2.0
+ * document of its own, and a feeds list in the same format as
+ * ass4's data/rss-feeds*.txt names every one of them with a file:// URL:
+ *
+ *     <feed name>: file://<directory>/feed-<k>.xml
+ *
+ * The URLs are built from the directory exactly as it was given, so a
+ * relative directory should be relative to wherever the indexer runs.
+ */
+
+#ifndef __feeds__
+#define __feeds__
+
+#include "grammar.h"
+#include "analysis.h"
+#include "bulk.h"
+#include <string>
+using namespace std;
+
+/**
+ * Function: generateFeeds
+ * -----------------------
+ * Creates the named directory (if it doesn't already exist), and
+ * writes feedCount feeds into it, along with a feeds list called
+ * feeds.txt.  The options.count items are generated by generateBulk,
+ * which deals them out among the feeds one item at a time and streams
+ * them straight into the files.
+ *
+ * @param options everything generateBulk needs but the feed URLs.
+ * @param directory the directory that receives the feeds and feeds list.
+ * @param feedCount the number of feeds to spread the items across.
+ * @param name the name the feeds are titled after, typically the grammar's.
+ * @param error set to a description of what went wrong on failure.
+ * @return true if and only if every feed and the feeds list were written.
+ */
+
+bool generateFeeds(const Grammar& grammar, const GrammarAnalysis& analysis, int start,
+		   const BulkOptions& options, const string& directory, int feedCount,
+		   const string& name, string& error);
+
+/**
+ * Function: appendEscapedXML
+ * --------------------------
+ * Appends the specified text to the end of the supplied string,
+ * replacing the characters that have special meaning in XML with
+ * the entities that stand for them.
+ */
+
+void appendEscapedXML(string& out, const string& text);
+
+#endif // ! __feeds__
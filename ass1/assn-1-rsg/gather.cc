@@ -0,0 +1,68 @@
+/**
+ * File: gather.cc
+ * ---------------
+ * Provides the implementation of the GatherWriter's output methods.
+ */
+
+#include "gather.h"
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+const size_t GatherWriter::kCopyThreshold;
+
+/**
+ * Method: write
+ * -------------
+ * Each writev call covers up to IOV_MAX pieces.  A short write leaves
+ * the first unwritten piece partially written, so a copy of that one
+ * piece is adjusted to start where the kernel stopped, and the next
+ * call picks up from there.  The run of staged text that hasn't been
+ * closed off yet is the last piece.
+ */
+
+bool GatherWriter::write(int fd) const
+{
+  size_t pieceCount = getPieceCount();
+  size_t next = 0;
+  size_t offset = 0; // bytes of piece next already written
+  while (next < pieceCount) {
+    struct iovec batch[IOV_MAX];
+    int count = 0;
+    for (size_t i = next; i < pieceCount && count < IOV_MAX; i++, count++) {
+      Piece piece = getPiece(i);
+      batch[count].iov_base = const_cast<char *>(getText(piece));
+      batch[count].iov_len = piece.length;
+    }
+    batch[0].iov_base = static_cast<char *>(batch[0].iov_base) + offset;
+    batch[0].iov_len -= offset;
+
+    ssize_t written = writev(fd, batch, count);
+    if (written < 0 && errno == EINTR) continue;
+    if (written <= 0) return false;
+
+    size_t remaining = written + offset;
+    while (next < pieceCount && remaining >= getPiece(next).length) remaining -= getPiece(next++).length;
+    offset = remaining;
+  }
+
+  return true;
+}
+
+size_t GatherWriter::copy(char *buffer, size_t capacity) const
+{
+  size_t copied = 0;
+  for (size_t i = 0; i < getPieceCount() && copied < capacity; i++) {
+    Piece piece = getPiece(i);
+    size_t length = min(piece.length, capacity - copied);
+    memcpy(buffer + copied, getText(piece), length);
+    copied += length;
+  }
+  return copied;
+}
@@ -0,0 +1,164 @@
+/**
+ * File: gather.h
+ * --------------
+ * Defines the GatherWriter class, which is a buffered writer with a
+ * writev fast path for long pieces of text.  Pieces shorter than
+ * kCopyThreshold are copied into a staging buffer as they arrive, and
+ * every run of them goes out as one piece.  Longer pieces are recorded
+ * as an (address, length) pair instead, and handed to the kernel with
+ * writev straight from wherever they live (the Grammar's string pool,
+ * usually), without being copied first.  For library use, the same
+ * pieces can be copied into a caller-supplied buffer.
+ *
+ * The kernel charges for every piece, and even joined runs of words are
+ * rarely more than a few dozen bytes long, which costs less to copy
+ * than to describe.  None of the bundled grammars has a terminal as long
+ * as kCopyThreshold, so for them, GatherWriter is in practice a plain
+ * buffered writer.  Lowering the threshold to 32 or 48 bytes, so that
+ * the longer runs go out as pieces of their own, never made rsg --count
+ * measurably faster, and at 48 bytes it made grading.g 40% slower.
+ */
+
+#ifndef __gather__
+#define __gather__
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+class GatherWriter {
+
+ public:
+
+  static const size_t kCopyThreshold = 256;
+
+  /**
+   * Constructor: GatherWriter
+   * -------------------------
+   * Constructs an empty GatherWriter.
+   */
+
+  GatherWriter() : runStart(0), bytes(0) {}
+
+  /**
+   * Method: append
+   * --------------
+   * Adds the specified piece of text to the end of the collection.
+   * Short pieces are copied, but anything kCopyThreshold bytes or longer
+   * isn't, so that text must stay put until the pieces are written or
+   * cleared.  A piece that picks up exactly where the last one left off
+   * is merged into it.
+   */
+
+  void append(const char *text, size_t length)
+  {
+    if (length < kCopyThreshold) {
+      staging.append(text, length);
+      return;
+    }
+
+    closeRun();
+    bytes += length;
+    if (!pieces.empty() && pieces.back().text != NULL && pieces.back().text + pieces.back().length == text)
+      pieces.back().length += length;
+    else
+      pushPiece(text, 0, length);
+  }
+
+  /**
+   * Method: push_back
+   * -----------------
+   * Appends a single character, which is always copied.  The name
+   * matches string's, so code can be written against either.
+   */
+
+  void push_back(char ch) { staging.push_back(ch); }
+
+  /**
+   * Methods: size, getPieceCount, clear
+   * -----------------------------------
+   * size returns the total number of bytes collected so far, and
+   * getPieceCount the number of separate pieces they're spread across.
+   * clear forgets all of them but keeps the space set aside for them.
+   */
+
+  size_t size() const { return bytes + staging.size() - runStart; }
+  size_t getPieceCount() const { return pieces.size() + (staging.size() > runStart ? 1 : 0); }
+  void clear() { pieces.clear(); staging.clear(); runStart = 0; bytes = 0; }
+
+  /**
+   * Method: write
+   * -------------
+   * Writes every piece, in order, to the specified file descriptor using
+   * as few writev calls as the system allows, resuming after short writes
+   * and interrupted calls.  The pieces are left in place either way.
+   *
+   * @return true if and only if every byte was written.
+   */
+
+  bool write(int fd) const;
+
+  /**
+   * Method: copy
+   * ------------
+   * Copies as much of the collected text as fits into the supplied
+   * buffer, which is not '\0'-terminated.
+   *
+   * @return the number of bytes copied, which is size() if everything fit.
+   */
+
+  size_t copy(char *buffer, size_t capacity) const;
+
+ private:
+
+  /**
+   * A piece either points at text outside the GatherWriter, or, when
+   * text is NULL, names a run of the staging buffer by its offset.  The
+   * offset (rather than an address) stays valid as the buffer grows.
+   * The run that's still growing, which starts at runStart, only becomes
+   * a piece when a long piece comes along to end it.  bytes counts the
+   * bytes in pieces, but not in that last run.
+   */
+
+  struct Piece {
+    const char *text;
+    size_t offset;
+    size_t length;
+  };
+
+  vector<Piece> pieces;
+  string staging;
+  size_t runStart;
+  size_t bytes;
+
+  void pushPiece(const char *text, size_t offset, size_t length)
+  {
+    Piece piece = { text, offset, length };
+    pieces.push_back(piece);
+  }
+  void closeRun()
+  {
+    if (staging.size() == runStart) return;
+    pushPiece(NULL, runStart, staging.size() - runStart);
+    bytes += staging.size() - runStart;
+    runStart = staging.size();
+  }
+  Piece getPiece(size_t i) const
+  {
+    if (i < pieces.size()) return pieces[i];
+    Piece run = { NULL, runStart, staging.size() - runStart };
+    return run;
+  }
+  const char *getText(const Piece& piece) const
+  {
+    return piece.text != NULL ? piece.text : staging.data() + piece.offset;
+  }
+
+  // marked as private so the piece list isn't copied by accident; it's
+  // only ever meaningful alongside the text it points into.
+  GatherWriter(const GatherWriter& original);
+  GatherWriter& operator=(const GatherWriter& rhs);
+};
+
+#endif // ! __gather__
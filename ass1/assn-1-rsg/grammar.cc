@@ -0,0 +1,487 @@
+/**
+ * File: grammar.cc
+ * ----------------
+ * Provides the implementation of the Grammar class, which compiles
+ * a map<string, Definition> into flat arrays that can be expanded
+ * without consulting any strings other than the terminal pool, and
+ * which saves and maps those arrays as a single image.
+ */
+
+#include "grammar.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * Function: internNonterminal
+ * ---------------------------
+ * Returns the id assigned to the specified nonterminal, assigning it
+ * the next available id (and recording its name) the first time it's seen.
+ */
+
+static int internNonterminal(string_view nonterminal, map<string_view, int>& ids,
+			     vector<string_view>& names)
+{
+  map<string_view, int>::iterator found = ids.find(nonterminal);
+  if (found != ids.end()) return found->second;
+  int id = names.size();
+  ids[nonterminal] = id;
+  names.push_back(nonterminal);
+  return id;
+}
+
+/**
+ * Function: internTerminal
+ * ------------------------
+ * Returns the index of the terminal with the specified text, adding
+ * it to the pool (along with its word count) the first time it's seen.
+ */
+
+static int internTerminal(const string& text, uint32_t words, map<string, int>& indices, string& pool,
+			  vector<uint32_t>& offsets, vector<uint32_t>& wordCounts)
+{
+  map<string, int>::iterator found = indices.find(text);
+  if (found != indices.end()) return found->second;
+  int index = wordCounts.size();
+  indices[text] = index;
+  pool += text;
+  offsets.push_back(pool.size());
+  wordCounts.push_back(words);
+  return index;
+}
+
+/**
+ * Function: copyArray
+ * -------------------
+ * Copies the contents of a vector into one of the image's arrays.
+ * Empty vectors are skipped, since their data may well be NULL.
+ */
+
+template <typename T>
+static void copyArray(const T *destination, const vector<T>& source)
+{
+  if (!source.empty()) memcpy(const_cast<T *>(destination), source.data(), source.size() * sizeof(T));
+}
+
+static const char kImageMagic[8] = { 'R', 'S', 'G', 'I', 'M', 'A', 'G', '3' };
+
+Grammar::Grammar() : mapping(NULL), mappingSize(0)
+{
+  compile(map<string, Definition>());
+}
+
+Grammar::Grammar(const map<string, Definition>& definitions) : mapping(NULL), mappingSize(0)
+{
+  compile(definitions);
+}
+
+Grammar::~Grammar()
+{
+  release();
+}
+
+/**
+ * Method: compile
+ * ---------------
+ * Compiles the Definitions in two passes.  The first pass interns
+ * every defined nonterminal so that ids are handed out in the same
+ * (sorted) order as the map.  The second pass flattens each Definition's
+ * Productions into the shared symbol array, interning nonterminals that
+ * are referenced but never defined, joining each run of consecutive
+ * words into a single terminal, and adding each distinct terminal to
+ * the string pool exactly once.  The arrays are then packed into
+ * a freshly allocated image.  Nonterminals are viewed in place, in
+ * the map's keys or the Definitions' Arena, rather than copied.
+ */
+
+void Grammar::compile(const map<string, Definition>& definitions)
+{
+  map<string_view, int> ids;
+  vector<string_view> nonterminals;
+  for (map<string, Definition>::const_iterator curr = definitions.begin();
+       curr != definitions.end(); ++curr)
+    internNonterminal(curr->first, ids, nonterminals);
+
+  map<string, int> terminals;
+  vector<uint32_t> weights, leaves, thresholds, aliases;
+  vector<uint32_t> productions, symbolOffsets, symbolList, charOffsets(1, 0), wordCounts, nameOffsets(1, 0);
+  string terminalText, nameText, run;
+  for (map<string, Definition>::const_iterator curr = definitions.begin();
+       curr != definitions.end(); ++curr) {
+    productions.push_back(symbolOffsets.size());
+    const Definition& def = curr->second;
+    weights.push_back(def.getTotalWeight());
+    bool isLeaf = def.begin() != def.end();
+    int i = 0;
+    for (Definition::const_iterator prod = def.begin(); prod != def.end(); ++prod, ++i) {
+      thresholds.push_back(def.getTotalWeight() == 0 ? 0 : def.getAcceptThreshold(i));
+      aliases.push_back(def.getTotalWeight() == 0 ? i : def.getAlias(i));
+      symbolOffsets.push_back(symbolList.size());
+      uint32_t runWords = 0;
+      for (Production::const_iterator word = prod->begin(); word != prod->end(); ++word) {
+	if (word->at(0) != '<') {
+	  if (runWords++ > 0) run += ' ';
+	  run += *word;
+	  continue;
+	}
+
+	if (runWords > 0) {
+	  symbolList.push_back(internTerminal(run, runWords, terminals, terminalText, charOffsets, wordCounts));
+	  run.clear();
+	  runWords = 0;
+	}
+	symbolList.push_back(kNonterminalTag | internNonterminal(*word, ids, nonterminals));
+	isLeaf = false;
+      }
+
+      if (runWords > 0) {
+	symbolList.push_back(internTerminal(run, runWords, terminals, terminalText, charOffsets, wordCounts));
+	run.clear();
+      }
+      if (symbolList.size() - symbolOffsets.back() > 1) isLeaf = false;
+    }
+    leaves.push_back(isLeaf ? 1 : 0);
+  }
+
+  // nonterminals that were referenced but never defined have no productions
+  while (productions.size() <= nonterminals.size())
+    productions.push_back(symbolOffsets.size());
+  weights.resize(nonterminals.size(), 0);
+  leaves.resize(nonterminals.size(), 0);
+  symbolOffsets.push_back(symbolList.size());
+  for (size_t id = 0; id < nonterminals.size(); id++) {
+    nameText += nonterminals[id];
+    nameOffsets.push_back(nameText.size());
+  }
+
+  ImageHeader layout;
+  memcpy(layout.magic, kImageMagic, sizeof(layout.magic));
+  layout.nonterminalCount = nonterminals.size();
+  layout.productionCount = symbolOffsets.size() - 1;
+  layout.symbolCount = symbolList.size();
+  layout.terminalCount = charOffsets.size() - 1;
+  layout.poolSize = terminalText.size();
+  layout.namesSize = nameText.size();
+
+  release();
+  storage.assign(getImageSize(layout) / sizeof(uint32_t), 0);
+  char *image = reinterpret_cast<char *>(storage.data());
+  memcpy(image, &layout, sizeof(layout));
+  attach(image);
+  copyArray(firstProduction, productions);
+  copyArray(totalWeight, weights);
+  copyArray(leaf, leaves);
+  copyArray(accept, thresholds);
+  copyArray(alias, aliases);
+  copyArray(firstSymbol, symbolOffsets);
+  copyArray(symbols, symbolList);
+  copyArray(firstChar, charOffsets);
+  copyArray(wordCount, wordCounts);
+  copyArray(firstName, nameOffsets);
+  memcpy(const_cast<char *>(pool), terminalText.data(), terminalText.size());
+  memcpy(const_cast<char *>(names), nameText.data(), nameText.size());
+}
+
+/**
+ * Static Method: getImageSize
+ * ---------------------------
+ * Computes the number of bytes occupied by an image with the
+ * specified counts.  The arithmetic is done with size_t, so even
+ * absurd counts read from a corrupt file can't overflow it.
+ */
+
+static size_t padded(size_t bytes) { return (bytes + 3) & ~static_cast<size_t>(3); }
+
+size_t Grammar::getImageSize(const ImageHeader& header)
+{
+  size_t size = sizeof(ImageHeader);
+  size += (static_cast<size_t>(header.nonterminalCount) + 1) * sizeof(uint32_t);
+  size += static_cast<size_t>(header.nonterminalCount) * 2 * sizeof(uint32_t);
+  size += static_cast<size_t>(header.productionCount) * 2 * sizeof(uint32_t);
+  size += (static_cast<size_t>(header.productionCount) + 1) * sizeof(uint32_t);
+  size += static_cast<size_t>(header.symbolCount) * sizeof(symbol);
+  size += (static_cast<size_t>(header.terminalCount) * 2 + 1) * sizeof(uint32_t);
+  size += (static_cast<size_t>(header.nonterminalCount) + 1) * sizeof(uint32_t);
+  size += padded(header.poolSize);
+  size += padded(header.namesSize);
+  return size;
+}
+
+/**
+ * Method: attach
+ * --------------
+ * Points the array pointers into the specified image, walking past
+ * each array in turn.  Nothing about the image is checked here.
+ */
+
+void Grammar::attach(const void *image)
+{
+  header = static_cast<const ImageHeader *>(image);
+  const uint32_t *words = reinterpret_cast<const uint32_t *>(header + 1);
+  firstProduction = words;
+  words += header->nonterminalCount + 1;
+  totalWeight = words;
+  words += header->nonterminalCount;
+  leaf = words;
+  words += header->nonterminalCount;
+  accept = words;
+  words += header->productionCount;
+  alias = words;
+  words += header->productionCount;
+  firstSymbol = words;
+  words += header->productionCount + 1;
+  symbols = words;
+  words += header->symbolCount;
+  firstChar = words;
+  words += header->terminalCount + 1;
+  wordCount = words;
+  words += header->terminalCount;
+  firstName = words;
+  words += header->nonterminalCount + 1;
+  pool = reinterpret_cast<const char *>(words);
+  names = pool + padded(header->poolSize);
+}
+
+/**
+ * Function: isMonotonic
+ * ---------------------
+ * Returns true if and only if the specified offset array starts at 0,
+ * never decreases, and ends at the specified total.
+ */
+
+static bool isMonotonic(const uint32_t *offsets, size_t count, uint32_t total)
+{
+  if (offsets[0] != 0 || offsets[count] != total) return false;
+  for (size_t i = 0; i < count; i++)
+    if (offsets[i] > offsets[i + 1]) return false;
+  return true;
+}
+
+/**
+ * Method: isConsistent
+ * --------------------
+ * Confirms that every offset, every alias, and every symbol in the
+ * attached image stays within bounds, that every terminal has at least
+ * one word, and that every leaf really is one, which is all it takes
+ * for expansion to be safe.
+ */
+
+bool Grammar::isConsistent() const
+{
+  if (!isMonotonic(firstProduction, header->nonterminalCount, header->productionCount) ||
+      !isMonotonic(firstSymbol, header->productionCount, header->symbolCount) ||
+      !isMonotonic(firstChar, header->terminalCount, header->poolSize) ||
+      !isMonotonic(firstName, header->nonterminalCount, header->namesSize))
+    return false;
+
+  for (uint32_t id = 0; id < header->nonterminalCount; id++) {
+    uint32_t count = firstProduction[id + 1] - firstProduction[id];
+    for (uint32_t i = firstProduction[id]; i < firstProduction[id + 1]; i++) {
+      if (alias[i] >= count || (totalWeight[id] != 0 && accept[i] > totalWeight[id])) return false;
+    }
+  }
+
+  for (uint32_t i = 0; i < header->symbolCount; i++) {
+    uint32_t limit = isNonterminal(symbols[i]) ? header->nonterminalCount : header->terminalCount;
+    if (static_cast<uint32_t>(indexOf(symbols[i])) >= limit) return false;
+  }
+
+  for (uint32_t i = 0; i < header->terminalCount; i++)
+    if (wordCount[i] == 0) return false;
+
+  for (uint32_t id = 0; id < header->nonterminalCount; id++) {
+    if (leaf[id] == 0) continue;
+    if (firstProduction[id] == firstProduction[id + 1]) return false;
+    for (uint32_t p = firstProduction[id]; p < firstProduction[id + 1]; p++) {
+      uint32_t length = firstSymbol[p + 1] - firstSymbol[p];
+      if (length > 1 || (length == 1 && isNonterminal(symbols[firstSymbol[p]]))) return false;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * Method: release
+ * ---------------
+ * Gives back whichever image is currently attached.
+ */
+
+void Grammar::release()
+{
+  if (mapping != NULL) munmap(mapping, mappingSize);
+  mapping = NULL;
+  mappingSize = 0;
+  vector<uint32_t>().swap(storage);
+}
+
+bool Grammar::isImage(const string& fileName)
+{
+  char magic[sizeof(kImageMagic)];
+  ifstream infile(fileName.c_str(), ios::in | ios::binary);
+  infile.read(magic, sizeof(magic));
+  return infile.gcount() == sizeof(magic) && memcmp(magic, kImageMagic, sizeof(magic)) == 0;
+}
+
+/**
+ * Method: load
+ * ------------
+ * Maps the file and attaches to it, falling back to the
+ * previous image if the new one doesn't pass inspection.
+ */
+
+bool Grammar::load(const string& fileName)
+{
+  int fd = open(fileName.c_str(), O_RDONLY);
+  if (fd == -1) return false;
+  struct stat info;
+  void *image = MAP_FAILED;
+  if (fstat(fd, &info) == 0 && info.st_size >= static_cast<off_t>(sizeof(ImageHeader)))
+    image = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // the mapping outlives the descriptor
+  if (image == MAP_FAILED) return false;
+
+  size_t size = info.st_size;
+  const ImageHeader *candidate = static_cast<const ImageHeader *>(image);
+  if (memcmp(candidate->magic, kImageMagic, sizeof(kImageMagic)) != 0 ||
+      getImageSize(*candidate) != size) {
+    munmap(image, size);
+    return false;
+  }
+
+  const ImageHeader *previous = header;
+  attach(image);
+  if (!isConsistent()) {
+    attach(previous);
+    munmap(image, size);
+    return false;
+  }
+
+  const void *current = header;
+  release();
+  attach(current);
+  mapping = image;
+  mappingSize = size;
+  return true;
+}
+
+/**
+ * Method: read
+ * ------------
+ * Reads the whole file into a buffer of words (so the image is aligned
+ * just as a mapping would be) and inspects it in place, just as load
+ * does, before the buffer becomes the Grammar's storage.  Swapping the
+ * vectors keeps the buffer where it is, so the pointers attach set up
+ * stay good.
+ */
+
+bool Grammar::read(const string& fileName)
+{
+  ifstream infile(fileName.c_str(), ios::in | ios::binary);
+  if (infile.fail()) return false;
+  infile.seekg(0, ios::end);
+  streamoff size = infile.tellg();
+  infile.seekg(0, ios::beg);
+  if (size < static_cast<streamoff>(sizeof(ImageHeader)) || size % sizeof(uint32_t) != 0) return false;
+
+  vector<uint32_t> image(size / sizeof(uint32_t));
+  infile.read(reinterpret_cast<char *>(image.data()), size);
+  const ImageHeader *candidate = reinterpret_cast<const ImageHeader *>(image.data());
+  if (infile.gcount() != size || memcmp(candidate->magic, kImageMagic, sizeof(kImageMagic)) != 0 ||
+      getImageSize(*candidate) != static_cast<size_t>(size))
+    return false;
+
+  const ImageHeader *previous = header;
+  attach(image.data());
+  if (!isConsistent()) {
+    attach(previous);
+    return false;
+  }
+
+  release();
+  storage.swap(image);
+  attach(storage.data());
+  return true;
+}
+
+/**
+ * Method: save
+ * ------------
+ * The temporary file is created by mkstemp, so it gets a name no one
+ * else is using, and two saves of the same file (or a save and a reload
+ * of it) can't clobber each other's half-written images.  mkstemp makes
+ * the file readable by its owner alone, so it's given the same 0644
+ * that rsg -o uses before it's renamed into place.
+ */
+
+bool Grammar::save(const string& fileName) const
+{
+  string temporaryName = fileName + ".XXXXXX";
+  int fd = mkstemp(&temporaryName[0]);
+  if (fd == -1) return false;
+
+  const char *next = reinterpret_cast<const char *>(header);
+  size_t remaining = getImageSize(*header);
+  bool written = fchmod(fd, 0644) == 0;
+  while (written && remaining > 0) {
+    ssize_t count = write(fd, next, remaining);
+    if (count < 0 && errno == EINTR) continue;
+    if (count <= 0) written = false;
+    else {
+      next += count;
+      remaining -= count;
+    }
+  }
+  if (close(fd) != 0) written = false;
+  if (written && rename(temporaryName.c_str(), fileName.c_str()) == 0) return true;
+  remove(temporaryName.c_str());
+  return false;
+}
+
+int Grammar::lookup(const string& nonterminal) const
+{
+  for (int id = 0; id < getNonterminalCount(); id++) {
+    size_t length = firstName[id + 1] - firstName[id];
+    if (length == nonterminal.size() && memcmp(names + firstName[id], nonterminal.data(), length) == 0)
+      return id;
+  }
+  return -1;
+}
+
+int Grammar::getUndefinedNonterminal() const
+{
+  for (int id = 0; id < getNonterminalCount(); id++)
+    if (firstProduction[id] == firstProduction[id + 1]) return id;
+  return -1;
+}
+
+/**
+ * Method: getProbabilities
+ * ------------------------
+ * Each column of a nonterminal's alias table is chosen with probability
+ * 1/n, and it then splits its share between the column's own production
+ * (accept / totalWeight of the time) and its alias (the rest of the time).
+ */
+
+void Grammar::getProbabilities(vector<double>& probabilities) const
+{
+  probabilities.assign(getProductionCount(), 0.0);
+  for (int id = 0; id < getNonterminalCount(); id++) {
+    uint32_t first = firstProduction[id];
+    uint32_t count = firstProduction[id + 1] - first;
+    for (uint32_t i = first; i < first + count; i++) {
+      if (totalWeight[id] == 0) {
+	probabilities[i] += 1.0 / count;
+	continue;
+      }
+      double kept = static_cast<double>(accept[i]) / totalWeight[id];
+      probabilities[i] += kept / count;
+      probabilities[first + alias[i]] += (1.0 - kept) / count;
+    }
+  }
+}
@@ -0,0 +1,334 @@
+/**
+ * File: grammar.h
+ * ---------------
+ * Defines the Grammar class, which is the compiled form of
+ * the map<string, Definition> built up by readGrammar.  Every
+ * nonterminal is interned to a dense integer id, every Production
+ * is flattened into one shared array of tagged symbols, and all
+ * of the terminal text lives in a single string pool.  Expanding
+ * a compiled Grammar (see expander.h) does no map lookups and copies
+ * no strings other than the terminals it emits.
+ *
+ * Consecutive words of a production that aren't nonterminals are
+ * joined, spaces and all, into a single terminal when the grammar is
+ * compiled, so a production made up entirely of words is emitted in one
+ * step.  A nonterminal whose every production is a single terminal (or
+ * nothing at all) is marked as a leaf, and expanding it is just a
+ * matter of choosing a production and emitting its terminal.
+ *
+ * All of those arrays live in one flat, relocatable image: every
+ * reference within it is an offset rather than a pointer.  The image
+ * can be written to disk (rsg --compile) and later mapped straight
+ * back into memory, so a precompiled grammar is ready to expand without
+ * any parsing at all.  Images are written in the machine's native
+ * byte order.
+ */
+
+#ifndef __grammar__
+#define __grammar__
+
+#include "definition.h"
+#include "random.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+class Grammar {
+
+ public:
+
+  /**
+   * Type: symbol
+   * ------------
+   * A symbol is the compiled form of a single nonterminal, or of a
+   * run of consecutive words, in a Production.
+   * The high bit tags the symbol as a nonterminal, and the remaining
+   * bits are either the nonterminal's id or the index of the terminal
+   * within the string pool.
+   */
+
+  typedef uint32_t symbol;
+  static const symbol kNonterminalTag = 0x80000000u;
+
+  static bool isNonterminal(symbol s) { return (s & kNonterminalTag) != 0; }
+  static int indexOf(symbol s) { return static_cast<int>(s & ~kNonterminalTag); }
+
+  /**
+   * Default Constructor: Grammar
+   * ----------------------------
+   * Constructs the empty Grammar, which has no nonterminals at all.
+   * It's typically replaced by a call to load.
+   */
+
+  Grammar();
+
+  /**
+   * map Constructor: Grammar
+   * ------------------------
+   * Compiles the specified collection of Definitions.  Nonterminals
+   * that are referenced by some Production but never defined are still
+   * assigned an id, but they have no productions of their own (see
+   * getUndefinedNonterminal).
+   *
+   * @param definitions the map of nonterminal strings to Definitions
+   *                    populated by readGrammar.
+   */
+
+  Grammar(const map<string, Definition>& definitions);
+
+  /**
+   * Method: compile
+   * ---------------
+   * Replaces the receiving Grammar with the compiled form of the
+   * specified Definitions, exactly as the map constructor would.
+   */
+
+  void compile(const map<string, Definition>& definitions);
+
+  /**
+   * Destructor: ~Grammar
+   * --------------------
+   * Releases the image, unmapping it if it was loaded from a file.
+   */
+
+  ~Grammar();
+
+  /**
+   * Static Method: isImage
+   * ----------------------
+   * Returns true if and only if the named file exists and begins
+   * like an image written by save, as opposed to a text grammar.
+   */
+
+  static bool isImage(const string& fileName);
+
+  /**
+   * Method: load
+   * ------------
+   * Replaces the receiving Grammar with the image stored in the named
+   * file.  The file is mapped into memory read-only rather than read, so
+   * nothing is parsed or copied.  The image's structure is checked before
+   * it's accepted, so a truncated or corrupt file is rejected rather than
+   * expanded.
+   *
+   * @param fileName the name of a file written by save.
+   * @return true if and only if the image was mapped and passed inspection.
+   *         On failure, the receiving Grammar is left unchanged.
+   */
+
+  bool load(const string& fileName);
+
+  /**
+   * Method: read
+   * ------------
+   * Replaces the receiving Grammar with the image stored in the named
+   * file, exactly as load does, except that the image is read into memory
+   * of the Grammar's own.  A mapped image is only as stable as the file
+   * behind it: if the file is truncated or rewritten in place, a mapping
+   * can fault or change underneath whatever is expanding it.  A Grammar
+   * that has to outlive changes to its file, as the server's do, should
+   * be read instead.
+   *
+   * @param fileName the name of a file written by save.
+   * @return true if and only if the image was read and passed inspection.
+   *         On failure, the receiving Grammar is left unchanged.
+   */
+
+  bool read(const string& fileName);
+
+  /**
+   * Method: save
+   * ------------
+   * Writes the receiving Grammar's image to the named file.  The image
+   * is written to a uniquely named temporary file alongside it and
+   * renamed into place, so anything that mapped the file's old contents
+   * keeps them intact, nothing ever maps a partly written image, and
+   * saves that race each other never share a temporary file.
+   *
+   * @return true if and only if the entire image was written.
+   */
+
+  bool save(const string& fileName) const;
+
+  /**
+   * Method: getNonterminalCount
+   * ---------------------------
+   * Returns the number of distinct nonterminals, which is
+   * one more than the largest nonterminal id.
+   */
+
+  int getNonterminalCount() const { return header->nonterminalCount; }
+
+  /**
+   * Method: getNonterminal
+   * ----------------------
+   * Returns the nonterminal string (with the '<' and '>' on either
+   * side) that was interned to the specified id.
+   */
+
+  string getNonterminal(int id) const
+  {
+    return string(names + firstName[id], firstName[id + 1] - firstName[id]);
+  }
+
+  /**
+   * Method: lookup
+   * --------------
+   * Returns the id of the specified nonterminal, or -1 if the
+   * nonterminal never appeared in the grammar.  This is the only
+   * place a compiled Grammar consults nonterminals by name.
+   */
+
+  int lookup(const string& nonterminal) const;
+
+  /**
+   * Method: getUndefinedNonterminal
+   * -------------------------------
+   * Returns the id of some nonterminal that is referenced by a
+   * Production but has no Definition of its own, or -1 if every
+   * referenced nonterminal is defined.  Expanding an undefined
+   * nonterminal is an error.
+   */
+
+  int getUndefinedNonterminal() const;
+
+  /**
+   * Predicate Method: isLeaf
+   * ------------------------
+   * Returns true if and only if every one of the specified
+   * nonterminal's productions is either empty or a single terminal.
+   * Undefined nonterminals are never leaves.
+   */
+
+  bool isLeaf(int id) const { return leaf[id] != 0; }
+
+  /**
+   * Methods: getProductionCount, beginProductions, endProductions
+   * -------------------------------------------------------------
+   * Productions are numbered 0 through getProductionCount() - 1, and
+   * each nonterminal's productions occupy the half-open range
+   * [beginProductions(id), endProductions(id)).
+   */
+
+  int getProductionCount() const { return header->productionCount; }
+  int beginProductions(int id) const { return firstProduction[id]; }
+  int endProductions(int id) const { return firstProduction[id + 1]; }
+
+  /**
+   * Method: getProbabilities
+   * ------------------------
+   * Fills the supplied vector with the probability that chooseProduction
+   * picks each production, indexed by production.  The weights themselves
+   * aren't stored, so they're recovered from the alias tables.
+   */
+
+  void getProbabilities(vector<double>& probabilities) const;
+
+  /**
+   * Method: chooseProduction
+   * ------------------------
+   * Chooses one of the specified nonterminal's productions at random,
+   * with probability proportional to its weight, and returns its index.
+   * Uniform nonterminals need just one bounded draw; weighted ones use
+   * their alias table and need exactly two.  The nonterminal must be
+   * defined.
+   */
+
+  int chooseProduction(int id, RandomGenerator& random) const
+  {
+    uint32_t first = firstProduction[id];
+    uint32_t column = first + random.getRandomBelow(firstProduction[id + 1] - first);
+    if (totalWeight[id] == 0 || random.getRandomBelow(totalWeight[id]) < accept[column])
+      return column;
+    return first + alias[column];
+  }
+
+  /**
+   * Methods: getTotalWeight, getAcceptThreshold, getAlias
+   * -----------------------------------------------------
+   * Expose the alias tables behind chooseProduction, for code that has
+   * to make exactly the same choices from the same draws (see
+   * rsg-codegen).  getTotalWeight returns 0 for uniform nonterminals,
+   * which have no tables.  Aliases are relative to the nonterminal's
+   * first production.
+   */
+
+  uint32_t getTotalWeight(int id) const { return totalWeight[id]; }
+  uint32_t getAcceptThreshold(int production) const { return accept[production]; }
+  int getAlias(int production) const { return alias[production]; }
+
+  /**
+   * Methods: beginSymbols, endSymbols
+   * ---------------------------------
+   * Return pointers to the first and the past-the-end symbol of the
+   * specified production.  Every production's symbols are laid out
+   * back to back, so these are just offsets into one array.
+   */
+
+  const symbol *beginSymbols(int production) const { return symbols + firstSymbol[production]; }
+  const symbol *endSymbols(int production) const { return symbols + firstSymbol[production + 1]; }
+
+  /**
+   * Methods: getTerminal, getTerminalLength, getTerminalWordCount
+   * -------------------------------------------------------------
+   * Return the address and length of the specified terminal's text
+   * within the string pool, and the number of words that were joined to
+   * make it.  The text is not '\0'-terminated.
+   */
+
+  const char *getTerminal(int index) const { return pool + firstChar[index]; }
+  int getTerminalLength(int index) const { return firstChar[index + 1] - firstChar[index]; }
+  int getTerminalWordCount(int index) const { return wordCount[index]; }
+
+ private:
+
+  /**
+   * The image opens with this header, and the arrays follow it
+   * in the order the pointers are declared below, each padded out
+   * to a multiple of four bytes.  The counts alone determine where
+   * every array starts.
+   */
+
+  struct ImageHeader {
+    char magic[8];
+    uint32_t nonterminalCount;
+    uint32_t productionCount;
+    uint32_t symbolCount;
+    uint32_t terminalCount;
+    uint32_t poolSize;
+    uint32_t namesSize;
+  };
+
+  vector<uint32_t> storage;            // the image, when it was compiled or read into memory
+  void *mapping;                       // the image, when it was mapped from a file
+  size_t mappingSize;
+
+  const ImageHeader *header;
+  const uint32_t *firstProduction;     // nonterminal id -> productions, one extra entry at the end
+  const uint32_t *totalWeight;         // nonterminal id -> sum of weights, or 0 if uniform
+  const uint32_t *leaf;                // nonterminal id -> 1 if it's a leaf, 0 otherwise
+  const uint32_t *accept;              // production index -> alias table threshold
+  const uint32_t *alias;               // production index -> alias, relative to the first production
+  const uint32_t *firstSymbol;         // production index -> symbols, one extra entry at the end
+  const symbol *symbols;               // every production's symbols, back to back
+  const uint32_t *firstChar;           // terminal index -> pool, one extra entry at the end
+  const uint32_t *wordCount;           // terminal index -> number of words joined in it
+  const uint32_t *firstName;           // nonterminal id -> names, one extra entry at the end
+  const char *pool;                    // every distinct terminal, back to back
+  const char *names;                   // every nonterminal, back to back
+
+  static size_t getImageSize(const ImageHeader& header);
+  void attach(const void *image);
+  bool isConsistent() const;
+  void release();
+
+  // marked as private so Grammars can't be copy constructed or reassigned,
+  // since a mapped image would otherwise be unmapped twice.
+  Grammar(const Grammar& original);
+  Grammar& operator=(const Grammar& rhs);
+};
+
+#endif // ! __grammar__
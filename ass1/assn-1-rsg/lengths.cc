@@ -0,0 +1,201 @@
+/**
+ * File: lengths.cc
+ * ----------------
+ * Provides the implementation of the LengthDistribution class.  It's
+ * the same dynamic program DerivationCounter runs over words, run over
+ * bytes instead, with every production weighted by the probability that
+ * it's chosen: a production's symbols split a length among themselves
+ * in many ways, the probability of each split is the product of each
+ * symbol's probability, and every production keeps a suffix table of
+ * the probability that its symbols i through the end produce exactly n
+ * bytes.  The shortest expansion of every symbol bounds how the bytes
+ * can be split, which saves most of the work.
+ */
+
+#include "lengths.h"
+
+static const int kExtraSweeps = 64;
+
+const size_t LengthDistribution::kMaxChars;
+
+/**
+ * Constructor: LengthDistribution
+ * -------------------------------
+ * Fills in the tables one length at a time, shortest first.  Within a
+ * length, a production's total only needs the suffix tables up through
+ * its first symbol that can't expand to nothing, since that symbol takes
+ * at least a byte and leaves less for the rest.  So each length is done
+ * in two steps: the totals first (along with the suffixes they need),
+ * sweeping the nonterminals in an order that puts the ones they depend
+ * on first, and then the rest of the suffixes, which only depend on the
+ * finished totals.  If the totals depend on each other in a cycle, they're
+ * instead swept until nothing changes.  Probabilities converge rather
+ * than settle when something can derive itself without emitting
+ * anything, so those sweeps are capped, and whatever is left by then is
+ * far too small to matter.
+ */
+
+LengthDistribution::LengthDistribution(const Grammar& grammar, const GrammarAnalysis& analysis,
+				       size_t maxChars) :
+  grammar(grammar), analysis(analysis), maxLength(maxChars + 1) // the first terminal has no separator
+{
+  int nonterminalCount = grammar.getNonterminalCount();
+  int productionCount = grammar.getProductionCount();
+  grammar.getProbabilities(weights);
+  probabilities.assign(static_cast<size_t>(nonterminalCount) * (maxLength + 1), 0.0);
+  firstSuffix.resize(productionCount);
+  firstSolid.resize(productionCount);
+  size_t size = 0;
+  for (int p = 0; p < productionCount; p++) {
+    const Grammar::symbol *symbols = grammar.beginSymbols(p);
+    int count = grammar.endSymbols(p) - symbols;
+    firstSuffix[p] = size;
+    size += static_cast<size_t>(count + 1) * (maxLength + 1);
+    firstSolid[p] = count - 1; // or the last symbol, if they can all be empty
+    for (int i = count - 1; i >= 0; i--)
+      if (getSymbolMinLength(symbols[i]) != 0) firstSolid[p] = i;
+  }
+  suffixes.assign(size, 0.0);
+  for (int p = 0; p < productionCount; p++)
+    suffixes[suffixIndex(p, grammar.endSymbols(p) - grammar.beginSymbols(p), 0)] = 1.0;
+
+  bool cyclic = orderNonterminals();
+  for (size_t length = 0; length <= maxLength; length++) {
+    bool changed = sweep(length);
+    for (int round = 0; cyclic && changed && round <= nonterminalCount + kExtraSweeps; round++)
+      changed = sweep(length);
+    for (int p = 0; p < productionCount; p++)
+      computeSuffixes(p, firstSolid[p] + 1, grammar.endSymbols(p) - grammar.beginSymbols(p) - 1, length);
+  }
+}
+
+/**
+ * Method: getSymbolMinLength
+ * --------------------------
+ * Returns the length of the shortest expansion of a single symbol,
+ * which for a terminal is its only one.
+ */
+
+uint64_t LengthDistribution::getSymbolMinLength(Grammar::symbol s) const
+{
+  if (Grammar::isNonterminal(s)) return analysis.getMinLength(Grammar::indexOf(s));
+  return grammar.getTerminalLength(Grammar::indexOf(s)) + 1;
+}
+
+/**
+ * Method: orderNonterminals
+ * -------------------------
+ * Fills in order so that every nonterminal comes after the ones whose
+ * probability of the same length its own depends on: those that some
+ * production of it can expand to all on their own, with every other
+ * symbol expanding to nothing.  It's built up a pass at a time, taking
+ * every nonterminal whose dependencies are all in place, and whatever's
+ * left when a pass takes nothing goes at the end.  Returns true if and
+ * only if anything was left.
+ */
+
+bool LengthDistribution::orderNonterminals()
+{
+  int nonterminalCount = grammar.getNonterminalCount();
+  vector<vector<int> > dependencies(nonterminalCount);
+  for (int id = 0; id < nonterminalCount; id++) {
+    for (int p = grammar.beginProductions(id); p < grammar.endProductions(id); p++) {
+      const Grammar::symbol *symbols = grammar.beginSymbols(p);
+      int count = grammar.endSymbols(p) - symbols;
+      int solid = 0;
+      for (int i = 0; i < count; i++)
+	if (getSymbolMinLength(symbols[i]) != 0) solid++;
+      for (int i = 0; i < count; i++) {
+	bool alone = solid == 0 || (solid == 1 && getSymbolMinLength(symbols[i]) != 0);
+	if (Grammar::isNonterminal(symbols[i]) && alone) dependencies[id].push_back(Grammar::indexOf(symbols[i]));
+      }
+    }
+  }
+
+  vector<bool> placed(nonterminalCount, false);
+  order.clear();
+  bool progress = true;
+  while (progress) {
+    progress = false;
+    for (int id = 0; id < nonterminalCount; id++) {
+      if (placed[id]) continue;
+      size_t i = 0;
+      while (i < dependencies[id].size() && placed[dependencies[id][i]]) i++;
+      if (i < dependencies[id].size()) continue;
+      placed[id] = true;
+      order.push_back(id);
+      progress = true;
+    }
+  }
+
+  bool cyclic = static_cast<int>(order.size()) < nonterminalCount;
+  for (int id = 0; id < nonterminalCount; id++)
+    if (!placed[id]) order.push_back(id);
+  return cyclic;
+}
+
+/**
+ * Method: computeSuffixes
+ * -----------------------
+ * Recomputes the production's suffix tables of the specified length
+ * for symbols last down through first (right to left, since each one
+ * builds on the next), given the current probabilities of that length
+ * and the final tables of every shorter one.  rest is the shortest
+ * expansion of everything after symbol i, so symbol i can take at most
+ * length - rest bytes.
+ */
+
+void LengthDistribution::computeSuffixes(int p, int first, int last, size_t length)
+{
+  const Grammar::symbol *symbols = grammar.beginSymbols(p);
+  uint64_t rest = 0;
+  for (int i = grammar.endSymbols(p) - symbols - 1; i > last && rest != GrammarAnalysis::kUnbounded; i--) {
+    uint64_t shortest = getSymbolMinLength(symbols[i]);
+    rest = shortest == GrammarAnalysis::kUnbounded ? shortest : rest + shortest;
+  }
+  for (int i = last; i >= first; i--) {
+    uint64_t shortest = getSymbolMinLength(symbols[i]);
+    double sum = 0.0;
+    if (shortest != GrammarAnalysis::kUnbounded && rest != GrammarAnalysis::kUnbounded &&
+	shortest + rest <= length) {
+      const double *following = &suffixes[suffixIndex(p, i + 1, 0)];
+      if (Grammar::isNonterminal(symbols[i])) {
+	const double *symbol = &probabilities[index(Grammar::indexOf(symbols[i]), 0)];
+	for (size_t taken = shortest; taken <= length - rest; taken++)
+	  sum += symbol[taken] * following[length - taken];
+      } else {
+	sum = following[length - shortest];
+      }
+    }
+    suffixes[suffixIndex(p, i, length)] = sum;
+    rest = shortest == GrammarAnalysis::kUnbounded ? shortest : rest + shortest;
+  }
+}
+
+/**
+ * Method: sweep
+ * -------------
+ * Recomputes the probabilities of the specified length, in order,
+ * along with the suffix tables they need.  Returns true if any
+ * probability changed.
+ */
+
+bool LengthDistribution::sweep(size_t length)
+{
+  bool changed = false;
+  for (size_t k = 0; k < order.size(); k++) {
+    int id = order[k];
+    double total = 0.0;
+    for (int p = grammar.beginProductions(id); p < grammar.endProductions(id); p++) {
+      computeSuffixes(p, 0, firstSolid[p], length);
+      total += weights[p] * suffixes[suffixIndex(p, 0, length)];
+    }
+
+    if (total != probabilities[index(id, length)]) {
+      probabilities[index(id, length)] = total;
+      changed = true;
+    }
+  }
+
+  return changed;
+}
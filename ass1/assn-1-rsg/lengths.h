@@ -0,0 +1,85 @@
+/**
+ * File: lengths.h
+ * ---------------
+ * Defines the LengthDistribution class, which computes the probability
+ * that each nonterminal, expanded the way the Expander expands it,
+ * comes out exactly n bytes long, for every n up to some bound.  The
+ * Expander uses those probabilities to generate sentences that fit in a
+ * budget (rsg --max-chars) without distorting what it generates: a
+ * sentence is drawn from exactly the distribution the Expander would
+ * produce without a budget, restricted to the sentences that fit.
+ *
+ * Lengths are measured the way GrammarAnalysis measures them, with
+ * each terminal counting one extra byte for the space before it.
+ */
+
+#ifndef __lengths__
+#define __lengths__
+
+#include "grammar.h"
+#include "analysis.h"
+#include <stddef.h>
+#include <vector>
+using namespace std;
+
+class LengthDistribution {
+
+ public:
+
+  // the work grows with the square of maxChars, and at 2000 characters
+  // it's still under half a second on the wordiest bundled grammar.
+  static const size_t kMaxChars = 2000;
+
+  /**
+   * Constructor: LengthDistribution
+   * -------------------------------
+   * Computes the probability of every length up to the one a sentence
+   * of maxChars characters has.  The work is O(n^2) in that length and
+   * is all done here, once, and the resulting tables are read-only, so a
+   * single LengthDistribution can be shared by any number of threads.
+   *
+   * @param grammar the compiled grammar, which must outlive the tables.
+   * @param analysis the grammar's analysis, whose shortest expansions
+   *                 rule out most of the lengths that can't happen.
+   * @param maxChars the longest sentence of interest, in characters,
+   *                 which should be at most kMaxChars.
+   */
+
+  LengthDistribution(const Grammar& grammar, const GrammarAnalysis& analysis, size_t maxChars);
+
+  size_t getMaxChars() const { return maxLength - 1; }
+
+  /**
+   * Method: getProbability
+   * ----------------------
+   * Returns the probability that the specified nonterminal expands to
+   * exactly the specified length, which must be at most getMaxChars() + 1.
+   */
+
+  double getProbability(int id, size_t length) const { return probabilities[index(id, length)]; }
+
+ private:
+  friend class Expander;
+
+  const Grammar& grammar;
+  const GrammarAnalysis& analysis;
+  size_t maxLength;
+  vector<double> weights;              // production index -> probability of being chosen
+  vector<double> probabilities;        // (id, length) -> probability of that exact length
+  vector<size_t> firstSuffix;          // production index -> suffix table
+  vector<double> suffixes;             // (production, i, length) -> probability of symbols i onward
+  vector<int> firstSolid;              // production index -> first symbol that can't be empty, or its last
+  vector<int> order;                   // the order nonterminals are swept in
+
+  size_t index(int id, size_t length) const { return static_cast<size_t>(id) * (maxLength + 1) + length; }
+  size_t suffixIndex(int production, int i, size_t length) const
+  {
+    return firstSuffix[production] + static_cast<size_t>(i) * (maxLength + 1) + length;
+  }
+  uint64_t getSymbolMinLength(Grammar::symbol s) const;
+  bool orderNonterminals();
+  void computeSuffixes(int p, int first, int last, size_t length);
+  bool sweep(size_t length);
+};
+
+#endif // ! __lengths__
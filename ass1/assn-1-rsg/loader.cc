@@ -0,0 +1,89 @@
+/**
+ * File: loader.cc
+ * ---------------
+ * Provides the implementation of the grammar loading functions.
+ */
+
+#include "loader.h"
+#include "definition.h"
+#include "production.h"
+#include "arena.h"
+#include <map>
+#include <fstream>
+#include <sys/stat.h>
+
+/**
+ * Takes a reference to a legitimate infile (one that's been set up
+ * to layer over a file) and populates the grammar map with the
+ * collection of definitions that are spelled out in the referenced
+ * file.  The function is written under the assumption that the
+ * referenced data file is really a grammar file that's properly
+ * formatted.  You may assume that all grammars are in fact properly
+ * formatted.
+ *
+ * @param infile a valid reference to a flat text file storing the grammar.
+ * @param arena the Arena that receives every Production and word, which
+ *              must outlive the map.
+ * @param grammar a reference to the STL map, which maps nonterminal strings
+ *                to their definitions.
+ * @return false if some Definition's weights add up to more than 32 bits
+ *         can hold, and true otherwise.
+ */
+
+static bool readGrammar(ifstream& infile, Arena& arena, map<string, Definition>& grammar)
+{
+  while (true) {
+    string uselessText;
+    getline(infile, uselessText, '{');
+    if (infile.eof()) return true;  // true? we encountered EOF before we saw a '{': no more productions!
+    infile.putback('{');
+    Definition def(infile, arena);
+    if (def.isOverweight()) return false;
+    Definition& slot = grammar[def.getNonterminal()];
+    slot = move(def);
+  }
+}
+
+/**
+ * Function: readGrammarFile
+ * -------------------------
+ * Everything the Definitions of a text grammar hold lives in one Arena,
+ * sized from the file so that it's usually a single chunk, and released
+ * in one go once the Grammar is compiled.
+ */
+
+LoadStatus readGrammarFile(const string& fileName, Grammar& grammar, bool copyImages)
+{
+  if (Grammar::isImage(fileName)) {
+    bool loaded = copyImages ? grammar.read(fileName) : grammar.load(fileName);
+    return loaded ? kLoaded : kCorrupt;
+  }
+  
+  ifstream grammarFile(fileName.c_str());
+  if (grammarFile.fail()) return kUnreadable;
+  
+  struct stat info;
+  size_t size = stat(fileName.c_str(), &info) == 0 ? info.st_size : 0;
+  Arena arena(max(Arena::kDefaultChunkSize, 4 * size));
+  map<string, Definition> definitions;
+  if (!readGrammar(grammarFile, arena, definitions)) return kMalformed;
+  grammar.compile(definitions);
+  return kLoaded;
+}
+
+int findStartSymbol(const Grammar& grammar, string& problem)
+{
+  int start = grammar.lookup("<start>");
+  if (start == -1) {
+    problem = "doesn't define <start>";
+    return -1;
+  }
+  
+  int undefined = grammar.getUndefinedNonterminal();
+  if (undefined != -1) {
+    problem = "references " + grammar.getNonterminal(undefined) + " without defining it";
+    return -1;
+  }
+  
+  return start;
+}
@@ -0,0 +1,57 @@
+/**
+ * File: loader.h
+ * --------------
+ * Defines the functions that turn a grammar file, whether it's
+ * a text grammar or an image written by rsg --compile, into a
+ * compiled Grammar that's ready to expand.  Both rsg and rsg-server
+ * load grammars through here.
+ */
+
+#ifndef __loader__
+#define __loader__
+
+#include "grammar.h"
+#include <string>
+using namespace std;
+
+/**
+ * Type: LoadStatus
+ * ----------------
+ * Describes how an attempt to load a grammar file went.  kUnreadable
+ * means the file couldn't be opened at all, kCorrupt means it
+ * looked like an image but failed inspection, and kMalformed means
+ * it's a text grammar with some nonterminal whose production weights
+ * add up to more than 32 bits can hold.
+ */
+
+enum LoadStatus { kLoaded, kUnreadable, kCorrupt, kMalformed };
+
+/**
+ * Function: readGrammarFile
+ * -------------------------
+ * Populates the supplied Grammar from the named file.  Images are
+ * mapped into memory as is, unless copyImages is true, in which case
+ * they're read into the Grammar's own memory (see Grammar::read); text
+ * grammars are read into a map<string, Definition> and compiled.  On
+ * failure, the Grammar is left as it was.
+ *
+ * @param fileName the name of the grammar file or image.
+ * @param grammar the Grammar to be replaced by the file's contents.
+ * @param copyImages true if the Grammar mustn't depend on the file afterwards.
+ * @return kLoaded on success, or the reason the file couldn't be loaded.
+ */
+
+LoadStatus readGrammarFile(const string& fileName, Grammar& grammar, bool copyImages = false);
+
+/**
+ * Function: findStartSymbol
+ * -------------------------
+ * Confirms that the Grammar defines <start> and every nonterminal it
+ * references, returning the id of <start>.  If it doesn't, -1 is
+ * returned and problem is set to a description that completes the
+ * sentence "The grammar file ...".
+ */
+
+int findStartSymbol(const Grammar& grammar, string& problem);
+
+#endif // ! __loader__
@@ -8,6 +8,32 @@
  */
 
 #include "production.h"
+#include <stdlib.h>
+#include <new>
+
+/**
+ * Function: parseWeight
+ * ---------------------
+ * Returns true and sets weight if the specified token is a positive
+ * integer in square brackets, and returns false without touching weight
+ * otherwise.  Weights are capped at kMaxWeight, so any Definition of
+ * fewer than 4295 Productions can sum its weights in 32 bits; the rare
+ * one that can't is rejected when the grammar is loaded.
+ */
+
+static const unsigned long kMaxWeight = 1000000;
+
+static bool parseWeight(const string& token, unsigned int& weight)
+{
+  if (token.size() < 3 || token[0] != '[' || token[token.size() - 1] != ']') return false;
+  if (token[1] < '0' || token[1] > '9') return false;
+  char *end;
+  unsigned long value = strtoul(token.c_str() + 1, &end, 10);
+  if (*end != ']' || end != token.c_str() + token.size() - 1) return false;
+  if (value == 0 || value > kMaxWeight) return false;
+  weight = value;
+  return true;
+}
 
 /**
  * Constructor Implementation: Production
@@ -21,22 +47,56 @@
  * to their own productions) are delimited by '<' and '>' and 
  * that no whitespace appears in between '<' and '>'.  The implementation
  * will also read the whitespace and the '\n' appearing after the 
- * semicolon and discard it.
+ * semicolon and discard it.  A bracketed weight is only recognized as
+ * the very first token.  The text of each word is copied into the
+ * Arena as soon as it's read, and the array of words follows once
+ * the semicolon shows how many there are.
  *
  * You are more than welcome to update this implementation to do
  * something else if you'd like to.
  */
 
-Production::Production(ifstream& infile)  // phrases is constructed, size is 0
+Production::Production(ifstream& infile, Arena& arena, vector<string_view>& scratch) : weight(1)
 {
+  scratch.clear();
+  string token;
+  bool weighted = false;
   while (true) {
-    string token;
     infile >> token;  // ignores whitespace by default
     if (token == ";") break;
-    phrases.push_back(token);
+    if (scratch.empty() && !weighted && parseWeight(token, weight)) {
+      weighted = true;
+      continue;
+    }
+    scratch.push_back(arena.copy(token));
   }
   
+  place(scratch, arena);
   string uselessText;
   getline(infile, uselessText); // read everything else as if it's important
   // oh, no it's not.. it's useless.. but we're glad it's been pulled from the stream..
 }
+
+Production::Production(const vector<string>& words, Arena& arena) : weight(1)
+{
+  vector<string_view> found;
+  for (size_t i = 0; i < words.size(); i++)
+    found.push_back(arena.copy(words[i]));
+  place(found, arena);
+}
+
+/**
+ * Method: place
+ * -------------
+ * Copies the views of the words into an array of their own in
+ * the Arena, which is what the Production's iterators walk over.
+ */
+
+void Production::place(const vector<string_view>& found, Arena& arena)
+{
+  wordCount = found.size();
+  string_view *placed = arena.allocateArray<string_view>(wordCount);
+  for (size_t i = 0; i < wordCount; i++)
+    new (placed + i) string_view(found[i]);
+  words = placed;
+}
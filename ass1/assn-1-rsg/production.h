@@ -3,16 +3,21 @@
  * ------------------
  * Defines the abstraction for the Production class, 
  * which encapsulates the functionality needed to store
- * a contiguous list of strings.
+ * a contiguous list of strings.  The strings, and the list
+ * itself, live in an Arena owned by whoever read the grammar, so
+ * a Production is nothing more than a lightweight handle that's
+ * only good for as long as its Arena is.
  */
  
 #ifndef __production__
 #define __production__
 
+#include "arena.h"
 #include <vector>
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <string_view>
 using namespace std;
 
 class Production {
@@ -24,8 +29,8 @@ class Production {
    * a Production instance.
    */
   
-  typedef vector<string>::iterator iterator;
-  typedef vector<string>::const_iterator const_iterator;
+  typedef const string_view *iterator;
+  typedef const string_view *const_iterator;
   
  public:
   
@@ -44,38 +49,57 @@ class Production {
    * have a default constructor.
    */
   
-  Production() {}
+  Production() : words(NULL), wordCount(0), weight(1) {}
   
   /**
    * ifstream Constructor: Production
    * --------------------------------
    * Initializes the Production based on the contents
-   * of the specified ifstream.  The ifstream is presumably
+   * of the specified ifstream, placing its words in the
+   * specified Arena.  The scratch vector collects the words
+   * until their number is known, and it's passed in so it can
+   * be reused from one Production to the next.  The ifstream is presumably
    * positions at the start of a line that houses a production.
    * Leading whitespace is discarded, the series of terminals and
    * non-terminals are read in until a semicolon is consumed, and
-   * the the rest of the data is discarded.
+   * the the rest of the data is discarded.  If the very first word
+   * is a positive integer in square brackets, as with
+   *
+   *     [3] <noun> ate my homework ;
+   *
+   * then it's taken to be the Production's weight rather than one of
+   * its words.  Productions without a weight have a weight of 1.
    */
   
-  Production(ifstream& infile);
+  Production(ifstream& infile, Arena& arena, vector<string_view>& scratch);
   
   /**
    * vector<string>-backed Constructor: Production
    * ---------------------------------------------
-   * Initializes a new Production to just encapsulate
-   * a copy of the provided vector.
+   * Initializes a new Production to encapsulate a copy
+   * of the provided vector, placed in the specified Arena.
    */
   
-  Production(const vector<string>& words) : phrases(words) {}
+  Production(const vector<string>& words, Arena& arena);
+  
+  /**
+   * Method: getWeight
+   * -----------------
+   * Returns the Production's weight, which is how many times more
+   * likely it is to be chosen than a Production of weight 1 belonging
+   * to the same Definition.
+   */
+  
+  unsigned int getWeight() const { return weight; }
   
   /**
    * Iterators: begin, end
    * ---------------------
    * Returns an iterator (fancy word for the generalization
    * of a pointer) to the first element or the past-the-end 
-   * element.  These iterators really are pointers to strings,
-   * so they respond properly to the notion of increment and
-   * dereference.
+   * element.  These iterators really are pointers to string_views
+   * (into the Arena), so they respond properly to the notion of
+   * increment and dereference.
    * 
    * These functions are provided so that the Production
    * class, which is really just an ordered collection of
@@ -83,16 +107,18 @@ class Production {
    * control idiom.
    *
    *    for (Production::iterator curr = prod.begin(); curr != prod.end(); ++curr) {
-   *        // manipulate curr (psuedo-pointer to C++ strings) or *curr (direct string objects).
+   *        // manipulate curr (pointer to a string_view) or *curr (the word itself).
    */
   
-  iterator begin() { return phrases.begin(); }
-  const_iterator begin() const { return phrases.begin(); }
-  iterator end() { return phrases.end(); }
-  const_iterator end() const { return phrases.end(); }
+  const_iterator begin() const { return words; }
+  const_iterator end() const { return words + wordCount; }
   
  private:
-  vector<string> phrases;
+  const string_view *words;
+  size_t wordCount;
+  unsigned int weight;
+  
+  void place(const vector<string_view>& found, Arena& arena);
 };
 
 #endif
@@ -0,0 +1,255 @@
+/**
+ * File: profile.cc
+ * ----------------
+ * Provides the implementation of the GrammarProfiler class.  The
+ * expansion loop is the Expander's, except that every production keeps
+ * its own frame until it's finished, even when its last symbol is a
+ * nonterminal, since that's when its subtree's bytes and time are known.
+ * Depth is still counted the Expander's way, by the frames with symbols
+ * left over, so the same sentences hit the same limits.
+ */
+
+#include "profile.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <stdio.h>
+
+static const size_t kProductionTextLength = 40;
+
+static int64_t now()
+{
+  return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+GrammarProfiler::GrammarProfiler(const Grammar& grammar) :
+  grammar(grammar), maxDepth(Expander::kDefaultMaxDepth), maxLength(string::npos), pendingFrames(0),
+  productionExpansions(grammar.getProductionCount(), 0), sentences(0), bytes(0), time(0)
+{
+  Totals zero = { 0, 0, 0, 0, 0, 0 };
+  totals.assign(grammar.getNonterminalCount(), zero);
+}
+
+/**
+ * Method: push
+ * ------------
+ * Chooses one of the specified nonterminal's productions, counts it,
+ * and starts a frame for it.
+ */
+
+void GrammarProfiler::push(int id, RandomGenerator& random, bool pending, size_t written)
+{
+  int production = grammar.chooseProduction(id, random);
+  productionExpansions[production]++;
+  totals[id].expansions++;
+  totals[id].active++;
+  if (pending) pendingFrames++;
+  Frame frame = { grammar.beginSymbols(production), grammar.endSymbols(production), id, pending,
+		  written, now(), 0 };
+  stack.push_back(frame);
+}
+
+/**
+ * Method: pop
+ * -----------
+ * Finishes the frame on top of the stack, charging its time (less its
+ * children's) to its nonterminal, and its subtree's bytes and time to
+ * the nonterminal's totals unless it's nested within another expansion
+ * of the same nonterminal.
+ */
+
+void GrammarProfiler::pop(size_t written)
+{
+  Frame frame = stack.back();
+  stack.pop_back();
+  int64_t elapsed = now() - frame.startTime;
+  Totals& nonterminal = totals[frame.id];
+  nonterminal.ownTime += elapsed - frame.childTime;
+  if (--nonterminal.active == 0) {
+    nonterminal.time += elapsed;
+    nonterminal.bytes += written - frame.startBytes;
+  }
+  if (frame.pending) pendingFrames--;
+  if (!stack.empty()) stack.back().childTime += elapsed;
+}
+
+/**
+ * Method: abandon
+ * ---------------
+ * Discards the frames of an expansion that hit a limit, without
+ * charging any bytes or time for them.
+ */
+
+void GrammarProfiler::abandon()
+{
+  for (size_t i = 0; i < stack.size(); i++) totals[stack[i].id].active--;
+  stack.clear();
+  pendingFrames = 0;
+}
+
+Expander::Outcome GrammarProfiler::expand(int start, RandomGenerator& random, string& sentence)
+{
+  sentence.clear();
+  stack.clear();
+  pendingFrames = 0;
+  int64_t started = now();
+  push(start, random, false, 0);
+  while (!stack.empty()) {
+    Frame& top = stack.back();
+    if (top.next == top.end) {
+      pop(sentence.size());
+      continue;
+    }
+
+    Grammar::symbol s = *top.next++;
+    int index = Grammar::indexOf(s);
+    if (Grammar::isNonterminal(s)) {
+      bool pending = top.next != top.end;
+      if (pending && pendingFrames + 1 >= maxDepth) {
+	abandon();
+	return Expander::kTooDeep;
+      }
+      push(index, random, pending, sentence.size());
+      continue;
+    }
+
+    size_t length = grammar.getTerminalLength(index);
+    size_t separator = sentence.empty() ? 0 : 1;
+    if (sentence.size() + separator + length > maxLength) {
+      abandon();
+      return Expander::kTooLong;
+    }
+    if (separator) sentence.push_back(' ');
+    sentence.append(grammar.getTerminal(index), length);
+    totals[top.id].ownBytes += separator + length;
+  }
+
+  time += now() - started;
+  bytes += sentence.size();
+  sentences++;
+  return Expander::kComplete;
+}
+
+/**
+ * Method: sortNonterminals
+ * ------------------------
+ * Fills order with the id of every nonterminal that was expanded at
+ * least once, most time-consuming first, with ties going to the
+ * nonterminal that produced more bytes.
+ */
+
+void GrammarProfiler::sortNonterminals(vector<int>& order) const
+{
+  order.clear();
+  for (int id = 0; id < grammar.getNonterminalCount(); id++)
+    if (totals[id].expansions > 0) order.push_back(id);
+  stable_sort(order.begin(), order.end(), MoreCostly(totals));
+}
+
+/**
+ * Method: describeProduction
+ * --------------------------
+ * Returns the words of the specified production, cut short (and marked
+ * with "...") if they run past kProductionTextLength characters.
+ */
+
+string GrammarProfiler::describeProduction(int production) const
+{
+  string text;
+  for (const Grammar::symbol *s = grammar.beginSymbols(production); s < grammar.endSymbols(production); s++) {
+    if (!text.empty()) text += ' ';
+    int index = Grammar::indexOf(*s);
+    if (Grammar::isNonterminal(*s)) text += grammar.getNonterminal(index);
+    else text.append(grammar.getTerminal(index), grammar.getTerminalLength(index));
+    if (text.size() > kProductionTextLength) return text.substr(0, kProductionTextLength - 3) + "...";
+  }
+  return text;
+}
+
+void GrammarProfiler::print(ostream& out) const
+{
+  vector<int> order;
+  sortNonterminals(order);
+  out << sentences << " sentences, " << bytes << " bytes, " << fixed << setprecision(3)
+      << time / 1e6 << " ms" << endl << endl;
+  out << left << setw(32) << "nonterminal" << right << setw(12) << "expansions" << setw(14) << "bytes"
+      << setw(12) << "own bytes" << setw(12) << "time (ms)" << setw(12) << "own (ms)" << setw(8) << "time %" << endl;
+  for (size_t i = 0; i < order.size(); i++) {
+    const Totals& nonterminal = totals[order[i]];
+    out << left << setw(32) << grammar.getNonterminal(order[i]) << right
+	<< setw(12) << nonterminal.expansions << setw(14) << nonterminal.bytes << setw(12) << nonterminal.ownBytes
+	<< setw(12) << setprecision(3) << nonterminal.time / 1e6 << setw(12) << nonterminal.ownTime / 1e6
+	<< setw(8) << setprecision(1) << (time > 0 ? 100.0 * nonterminal.time / time : 0.0) << endl;
+  }
+
+  vector<int> productions;
+  vector<int> owner(grammar.getProductionCount());
+  for (size_t i = 0; i < order.size(); i++) {
+    for (int p = grammar.beginProductions(order[i]); p < grammar.endProductions(order[i]); p++) {
+      productions.push_back(p);
+      owner[p] = order[i];
+    }
+  }
+  stable_sort(productions.begin(), productions.end(), MoreExpanded(productionExpansions));
+
+  out << endl << left << setw(32) << "nonterminal" << setw(kProductionTextLength + 2) << "production"
+      << right << setw(12) << "expansions" << setw(8) << "share %" << endl;
+  for (size_t i = 0; i < productions.size(); i++) {
+    int p = productions[i];
+    int id = owner[p];
+    out << left << setw(32) << grammar.getNonterminal(id) << setw(kProductionTextLength + 2) << describeProduction(p)
+	<< right << setw(12) << productionExpansions[p] << setw(8) << setprecision(1)
+	<< 100.0 * productionExpansions[p] / totals[id].expansions << endl;
+  }
+}
+
+/**
+ * Function: quoteJSON
+ * -------------------
+ * Returns the specified text as a JSON string literal.
+ */
+
+static string quoteJSON(const string& text)
+{
+  string literal = "\"";
+  for (size_t i = 0; i < text.size(); i++) {
+    unsigned char ch = text[i];
+    if (ch == '"' || ch == '\\') {
+      literal += '\\';
+      literal += ch;
+    } else if (ch < ' ') {
+      char escape[7];
+      snprintf(escape, sizeof(escape), "\\u%04x", ch);
+      literal += escape;
+    } else {
+      literal += ch;
+    }
+  }
+  return literal + "\"";
+}
+
+/**
+ * Method: printJSON
+ * -----------------
+ * Times are reported in nanoseconds, and each nonterminal's productions
+ * are listed in the order they're defined, by their expansion counts.
+ */
+
+void GrammarProfiler::printJSON(ostream& out) const
+{
+  vector<int> order;
+  sortNonterminals(order);
+  out << "{\"sentences\": " << sentences << ", \"bytes\": " << bytes << ", \"time\": " << time
+      << ", \"nonterminals\": [" << endl;
+  for (size_t i = 0; i < order.size(); i++) {
+    const Totals& nonterminal = totals[order[i]];
+    out << "  {\"name\": " << quoteJSON(grammar.getNonterminal(order[i]))
+	<< ", \"expansions\": " << nonterminal.expansions << ", \"bytes\": " << nonterminal.bytes
+	<< ", \"ownBytes\": " << nonterminal.ownBytes << ", \"time\": " << nonterminal.time
+	<< ", \"ownTime\": " << nonterminal.ownTime << ", \"productions\": [";
+    for (int p = grammar.beginProductions(order[i]); p < grammar.endProductions(order[i]); p++)
+      out << (p == grammar.beginProductions(order[i]) ? "" : ", ") << productionExpansions[p];
+    out << "]}" << (i + 1 < order.size() ? "," : "") << endl;
+  }
+  out << "]}" << endl;
+}
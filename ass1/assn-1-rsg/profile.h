@@ -0,0 +1,147 @@
+/**
+ * File: profile.h
+ * ---------------
+ * Defines the GrammarProfiler class, which expands sentences just as
+ * the Expander does while keeping track of where the work goes: how
+ * many times each nonterminal and each production is expanded, how many
+ * bytes each nonterminal's expansions contribute to the output, and how
+ * much time is spent expanding each one.  That's what rsg --profile
+ * reports, to show which parts of a large grammar dominate generation.
+ *
+ * Every figure comes in two flavours.  A nonterminal's own bytes and
+ * time are what it spends on the terminals of its own productions, and
+ * its total bytes and time include everything its subtree expands into.
+ * A recursive nonterminal's totals only count its outermost expansions,
+ * so nothing is counted twice.  Times include the profiler's own clock
+ * readings, so they're meant to be compared with one another rather
+ * than with ordinary runs.
+ */
+
+#ifndef __profile__
+#define __profile__
+
+#include "grammar.h"
+#include "expander.h"
+#include "random.h"
+#include <stdint.h>
+#include <ostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+class GrammarProfiler {
+
+ public:
+
+  /**
+   * Constructor: GrammarProfiler
+   * ----------------------------
+   * Constructs a GrammarProfiler with every count at zero.  The
+   * Grammar must outlive it.  The limits start out as the Expander's do.
+   */
+
+  GrammarProfiler(const Grammar& grammar);
+
+  /**
+   * Methods: setMaxDepth, setMaxLength
+   * ----------------------------------
+   * Impose the same limits as the Expander methods of the same names,
+   * measured in exactly the same way.
+   */
+
+  void setMaxDepth(size_t depth) { maxDepth = depth; }
+  void setMaxLength(size_t length) { maxLength = length; }
+
+  /**
+   * Method: expand
+   * --------------
+   * Replaces the contents of the supplied string with a random
+   * expansion of the specified nonterminal, adding everything it took to
+   * the profile.  The random numbers are drawn in the same order as the
+   * Expander draws them, so a profile of sentences 0 through N - 1 of
+   * some seed describes exactly the sentences rsg --count N prints.  An
+   * expansion that hits a limit is abandoned, but what it did up to
+   * that point still counts.
+   */
+
+  Expander::Outcome expand(int start, RandomGenerator& random, string& sentence);
+
+  /**
+   * Methods: print, printJSON
+   * -------------------------
+   * Write the profile as a pair of tables, or as a single JSON object.
+   * Nonterminals are listed in decreasing order of total time and
+   * productions in decreasing order of expansions.
+   */
+
+  void print(ostream& out) const;
+  void printJSON(ostream& out) const;
+
+ private:
+
+  /**
+   * Each frame is a production that's still being expanded, along with
+   * the output size and time when it started, and the time its children
+   * have taken so far.  pending records whether the frame counts toward
+   * the depth limit, which only frames with symbols left over do.
+   */
+
+  struct Frame {
+    const Grammar::symbol *next;
+    const Grammar::symbol *end;
+    int id;
+    bool pending;
+    size_t startBytes;
+    int64_t startTime;
+    int64_t childTime;
+  };
+
+  struct Totals {
+    uint64_t expansions;
+    uint64_t bytes;
+    uint64_t ownBytes;
+    int64_t time;
+    int64_t ownTime;
+    int active;                // expansions of this nonterminal on the stack
+  };
+
+  /**
+   * Comparators for sorting nonterminals by time (and then bytes)
+   * and productions by expansions, each in decreasing order.
+   */
+
+  struct MoreCostly {
+    const vector<Totals>& totals;
+    MoreCostly(const vector<Totals>& totals) : totals(totals) {}
+    bool operator()(int a, int b) const
+    {
+      if (totals[a].time != totals[b].time) return totals[a].time > totals[b].time;
+      return totals[a].bytes > totals[b].bytes;
+    }
+  };
+
+  struct MoreExpanded {
+    const vector<uint64_t>& expansions;
+    MoreExpanded(const vector<uint64_t>& expansions) : expansions(expansions) {}
+    bool operator()(int a, int b) const { return expansions[a] > expansions[b]; }
+  };
+
+  const Grammar& grammar;
+  size_t maxDepth;
+  size_t maxLength;
+  vector<Frame> stack;
+  size_t pendingFrames;
+  vector<Totals> totals;
+  vector<uint64_t> productionExpansions;
+  uint64_t sentences;
+  uint64_t bytes;
+  int64_t time;
+
+  void push(int id, RandomGenerator& random, bool pending, size_t written);
+  void pop(size_t written);
+  void abandon();
+  void sortNonterminals(vector<int>& order) const;
+  string describeProduction(int production) const;
+};
+
+#endif // ! __profile__
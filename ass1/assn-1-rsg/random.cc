@@ -1,37 +1,46 @@
 #include <time.h>
-#include <stdlib.h>
-#include <limits.h>
-#include <cassert> // for assert macro
 #include "random.h"
 
 /**
  * Constructor: RandomGenerator
  * ----------------------------
- * Initializes a RandomGenerator number generator, using 
+ * Initializes a RandomGenerator number generator, using
  * informtaion based on the current time as the seed.
  * This is the traditional way to set the stage for a computer
  * program to use random numbers.
  */
 
-RandomGenerator::RandomGenerator()
+RandomGenerator::RandomGenerator() : counterBased(false)
 {
-  srand(time(NULL));
+  setSeed(time(NULL));
 }
 
 /**
- * Method: getRandomInteger
- * ------------------------
- * Returns a seemingly random number between
- * the specified low and high, inclusive.  Based
- * on Eric Roberts' implementation from his
- * CS106A text.
+ * Method: setSeed
+ * ---------------
+ * Expands the seed into the four words of xoshiro256** state,
+ * which must not all be zero, by running SplitMix64 from the seed.
+ * Because SplitMix64 is a bijection of its counter, distinct seeds
+ * give distinct starting states.
  */
 
-int RandomGenerator::getRandomInteger(int low, int high)
+void RandomGenerator::setSeed(uint64_t seed)
 {
-  assert(low <= high);
-  double percent = (rand() / (static_cast<double>(RAND_MAX) + 1));
-  assert(percent >= 0.0 && percent < 1.0); 
-  int offset = static_cast<int>(percent * (high - low + 1));
-  return low + offset;
+  counterBased = false;
+  for (int i = 0; i < 4; i++)
+    state[i] = mix(seed += kGolden);
+}
+
+/**
+ * Method: setStream
+ * -----------------
+ * Derives the stream's key by mixing the seed and the index
+ * together, so that neighbouring indices land on unrelated
+ * stretches of the SplitMix64 sequence.
+ */
+
+void RandomGenerator::setStream(uint64_t seed, uint64_t index)
+{
+  counterBased = true;
+  counter = mix(seed ^ mix(index + kGolden));
 }
@@ -6,26 +6,124 @@
  * --------------
  * Provides a random number generator so
  * that pseudo-random numbers can be produced.
+ * Each RandomGenerator carries its own xoshiro256**
+ * state, so generators never share anything and
+ * threads can each own one without locking.  A generator
+ * can also be switched into a counter-based mode, where
+ * each stream of numbers is keyed on a seed and an index.
  */
 
+#include <stdint.h>
+#include <cassert>
+
 class RandomGenerator {
-  
- public: 
-  
+
+ public:
+
   /**
    * Constructor: RandomGenerator
    * ----------------------------
-   * Constructs a new RandomGenerator object.
+   * Constructs a new RandomGenerator object seeded
+   * from the current time.
    */
-  
+
   RandomGenerator();
 
+  /**
+   * Constructor: RandomGenerator
+   * ----------------------------
+   * Constructs a new RandomGenerator object whose sequence is
+   * determined entirely by the specified seed.  Two generators
+   * constructed with the same seed produce the same sequence.
+   *
+   * @param seed the value that determines the sequence of numbers produced.
+   */
+
+  RandomGenerator(uint64_t seed) : counterBased(false) { setSeed(seed); }
+
+  /**
+   * Method: setSeed
+   * ---------------
+   * Resets the generator so that it produces exactly the sequence
+   * a generator freshly constructed with the specified seed would.
+   * This also takes the generator out of counter-based mode.
+   */
+
+  void setSeed(uint64_t seed);
+
+  /**
+   * Method: setStream
+   * -----------------
+   * Switches the generator into counter-based mode, where the n-th
+   * number drawn is a pure function of the seed, the stream index, and n.
+   * Nothing carries over from one stream to the next, so the work can
+   * be carved up across any number of threads (or skipped over entirely)
+   * without changing what any one stream produces.  Bulk generation uses
+   * the sentence number as the stream index, which makes sentence i the
+   * same no matter how many threads generated the batch.
+   *
+   * @param seed the seed shared by every stream in the batch.
+   * @param index the number of the stream within the batch.
+   */
+
+  void setStream(uint64_t seed, uint64_t index);
+
+  /**
+   * Method: getRandomBits
+   * ---------------------
+   * Returns the next 64 uniformly distributed bits in the sequence.
+   * In counter-based mode, that's the SplitMix64 finalizer applied to
+   * the stream's key plus a multiple of the golden ratio.
+   */
+
+  uint64_t getRandomBits()
+  {
+    if (counterBased) return mix(counter += kGolden);
+    uint64_t result = rotate(state[1] * 5, 7) * 9;
+    uint64_t t = state[1] << 17;
+    state[2] ^= state[0];
+    state[3] ^= state[1];
+    state[1] ^= state[2];
+    state[0] ^= state[3];
+    state[2] ^= t;
+    state[3] = rotate(state[3], 45);
+    return result;
+  }
+
+  /**
+   * Method: getRandomBelow
+   * ----------------------
+   * Returns a number drawn uniformly from the range [0, bound).  This
+   * is the fast path behind getRandomInteger: one multiply and a shift
+   * maps 32 random bits onto the range, and the rare draws that would
+   * bias the result are rejected (Lemire's method), so no division
+   * happens unless a draw actually lands in the biased sliver.
+   *
+   * @param bound one more than the largest acceptable value.  Must be positive.
+   * @return some number drawn uniformly from the range [0, bound).
+   */
+
+  uint32_t getRandomBelow(uint32_t bound)
+  {
+    assert(bound > 0);
+    uint64_t product = (getRandomBits() >> 32) * bound;
+    uint32_t leftover = static_cast<uint32_t>(product);
+    if (leftover < bound) {
+      uint32_t threshold = -bound % bound;
+      while (leftover < threshold) {
+	product = (getRandomBits() >> 32) * bound;
+	leftover = static_cast<uint32_t>(product);
+      }
+    }
+    return product >> 32;
+  }
+
   /**
    * Method: getRandomInteger
    * ------------------------
    * Generates a seemingly random integer between the two specified
    * integers, inclusive.  All numbers in the range [low, high] are
-   * equally likely outcomes.  If low and high are the same, then 
+   * equally likely outcomes.  If low and high are the same, then
    * that number is guaranteed to be returned.  If low is greater than
    * high, then getRandomInteger asserts and ends the program.
    *
@@ -33,9 +131,35 @@ class RandomGenerator {
    * @param the highest number we'd like to be considered as a return value.
    * @return some number drawn uniformly from the range [low, high].
    */
-  
-  int getRandomInteger(int low, int high);  
+
+  int getRandomInteger(int low, int high)
+  {
+    assert(low <= high);
+    return low + static_cast<int>(getRandomBelow(static_cast<uint32_t>(high - low) + 1));
+  }
+
+  /**
+   * Method: getRandomFraction
+   * -------------------------
+   * Returns a double drawn uniformly from the range [0, 1), built
+   * from the top 53 bits of the next draw so every value is equally spaced.
+   */
+
+  double getRandomFraction() { return (getRandomBits() >> 11) * (1.0 / 9007199254740992.0); }
+
+ private:
+  static const uint64_t kGolden = 0x9e3779b97f4a7c15ULL;
+  uint64_t state[4];
+  bool counterBased;
+  uint64_t counter;
+
+  static uint64_t rotate(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+  static uint64_t mix(uint64_t z)
+  {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
 };
 
 #endif // ! __random__
-
@@ -0,0 +1,180 @@
+/**
+ * File: registry.cc
+ * -----------------
+ * Provides the implementation of the GrammarRegistry class.  Readers
+ * take no lock at all: they atomically load the current table and look
+ * things up in it.  Loading and analysis happen before any lock is
+ * taken, and writers only lock each other out while they copy the table
+ * and publish the copy.
+ */
+
+#include "registry.h"
+#include "loader.h"
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <algorithm>
+
+GrammarRegistry::GrammarRegistry() : table(new Table), inotify(-1)
+{
+  stopPipe[0] = stopPipe[1] = -1;
+}
+
+GrammarRegistry::~GrammarRegistry()
+{
+  if (inotify == -1) return;
+  close(stopPipe[1]);
+  watcher.join();
+  close(stopPipe[0]);
+  close(inotify);
+}
+
+/**
+ * Method: publish
+ * ---------------
+ * Replaces the table with a copy in which the named grammar is the
+ * one supplied, or is missing altogether if entry is empty.  Lookups
+ * that loaded the old table keep using it until they're done.
+ */
+
+void GrammarRegistry::publish(const string& name, const shared_ptr<const RegisteredGrammar>& entry)
+{
+  lock_guard<mutex> guard(updating);
+  shared_ptr<Table> replacement(new Table(*atomic_load(&table)));
+  if (entry) (*replacement)[name] = entry;
+  else replacement->erase(name);
+  atomic_store(&table, shared_ptr<const Table>(replacement));
+}
+
+bool GrammarRegistry::loadFile(const string& path, string& error)
+{
+  string name = path.substr(path.find_last_of('/') + 1);
+  shared_ptr<RegisteredGrammar> entry(new RegisteredGrammar);
+  entry->name = name;
+  LoadStatus status = readGrammarFile(path, entry->grammar, true); // requests outlive the file
+  if (status != kLoaded) {
+    error = status == kCorrupt ? "is corrupt or truncated" :
+      status == kMalformed ? "is malformed" : "couldn't be opened";
+    return false;
+  }
+
+  entry->start = findStartSymbol(entry->grammar, error);
+  if (entry->start == -1) return false;
+  entry->analysis.reset(new GrammarAnalysis(entry->grammar, entry->start));
+  if (!entry->analysis->isProductive(entry->start)) {
+    error = "can never finish expanding <start>";
+    return false;
+  }
+
+  publish(name, entry);
+  return true;
+}
+
+static bool isGrammarFileName(const string& fileName)
+{
+  return fileName.size() > 2 && fileName.compare(fileName.size() - 2, 2, ".g") == 0;
+}
+
+/**
+ * Method: loadDirectory
+ * ---------------------
+ * The directory's entries are sorted first so that the log comes out
+ * in a predictable order.
+ */
+
+int GrammarRegistry::loadDirectory(const string& directory, ostream& log)
+{
+  DIR *dir = opendir(directory.c_str());
+  if (dir == NULL) return -1;
+  vector<string> fileNames;
+  for (struct dirent *entry = readdir(dir); entry != NULL; entry = readdir(dir)) {
+    string fileName = entry->d_name;
+    if (isGrammarFileName(fileName)) fileNames.push_back(fileName);
+  }
+  closedir(dir);
+
+  sort(fileNames.begin(), fileNames.end());
+  int loaded = 0;
+  for (size_t i = 0; i < fileNames.size(); i++) {
+    string error;
+    if (loadFile(directory + "/" + fileNames[i], error)) loaded++;
+    else log << "Skipping \"" << fileNames[i] << "\", which " << error << "." << endl;
+  }
+  return loaded;
+}
+
+bool GrammarRegistry::watch(const string& directory, ostream& log)
+{
+  if (inotify != -1) return false;
+  inotify = inotify_init1(IN_CLOEXEC);
+  if (inotify == -1) return false;
+  if (inotify_add_watch(inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM) == -1 ||
+      pipe(stopPipe) == -1) {
+    close(inotify);
+    inotify = -1;
+    return false;
+  }
+
+  watcher = thread(&GrammarRegistry::watchEvents, this, directory, &log);
+  return true;
+}
+
+/**
+ * Method: watchEvents
+ * -------------------
+ * The body of the watcher thread, which waits for inotify events until
+ * the stop pipe is closed.  A file that's written is reported once it's
+ * closed, so a half-written grammar is never loaded; editors that save
+ * by renaming a temporary file into place show up as a move instead.
+ */
+
+void GrammarRegistry::watchEvents(string directory, ostream *log)
+{
+  char buffer[64 * 1024] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  struct pollfd fds[2] = { { inotify, POLLIN, 0 }, { stopPipe[0], POLLIN, 0 } };
+  while (true) {
+    if (poll(fds, 2, -1) == -1) {
+      if (errno == EINTR) continue;
+      *log << "Stopped watching \"" << directory << "\" for changes." << endl;
+      return;
+    }
+    if (fds[1].revents != 0) return;
+
+    ssize_t length = read(inotify, buffer, sizeof(buffer));
+    if (length <= 0) continue;
+    for (char *curr = buffer; curr < buffer + length; ) {
+      const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(curr);
+      curr += sizeof(struct inotify_event) + event->len;
+      string fileName = event->len > 0 ? event->name : "";
+      if (!isGrammarFileName(fileName)) continue;
+
+      if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+	publish(fileName, shared_ptr<const RegisteredGrammar>());
+	*log << "Dropped \"" << fileName << "\"." << endl;
+      } else {
+	string error;
+	if (loadFile(directory + "/" + fileName, error))
+	  *log << "Reloaded \"" << fileName << "\"." << endl;
+	else
+	  *log << "Keeping the old \"" << fileName << "\", if any, since the new one " << error << "." << endl;
+      }
+    }
+  }
+}
+
+shared_ptr<const RegisteredGrammar> GrammarRegistry::find(const string& name) const
+{
+  shared_ptr<const Table> current = atomic_load(&table);
+  Table::const_iterator found = current->find(name);
+  return found == current->end() ? shared_ptr<const RegisteredGrammar>() : found->second;
+}
+
+void GrammarRegistry::getNames(vector<string>& names) const
+{
+  shared_ptr<const Table> current = atomic_load(&table);
+  names.clear();
+  for (Table::const_iterator curr = current->begin(); curr != current->end(); ++curr)
+    names.push_back(curr->first);
+}
@@ -0,0 +1,153 @@
+/**
+ * File: registry.h
+ * ----------------
+ * Defines the GrammarRegistry class, which holds every grammar a
+ * long-running server has loaded, keyed by file name.  Each grammar is
+ * compiled and analyzed exactly once, and then shared by every request
+ * that names it.  Entries are handed out as shared_ptrs to immutable
+ * RegisteredGrammars, so a request that's using a grammar keeps it
+ * alive no matter what happens to the registry in the meantime.
+ *
+ * The registry can also watch its directory and reload any grammar
+ * whose file changes.  Updates are read-copy-update: the table of
+ * grammars is never modified in place.  Instead a new table is built
+ * alongside the old one and published with a single atomic pointer
+ * exchange, so lookups never wait on a reload, and a grammar that's
+ * been replaced lives on until the last request using it lets go.
+ */
+
+#ifndef __registry__
+#define __registry__
+
+#include "grammar.h"
+#include "analysis.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+/**
+ * Struct: RegisteredGrammar
+ * -------------------------
+ * A compiled grammar bundled with everything needed to expand it:
+ * the id of <start> and the grammar's analysis.  Never modified once
+ * it's been registered.
+ */
+
+struct RegisteredGrammar {
+  string name;
+  Grammar grammar;
+  int start;
+  unique_ptr<GrammarAnalysis> analysis;
+
+  RegisteredGrammar() : start(-1) {}
+};
+
+class GrammarRegistry {
+
+ public:
+
+  /**
+   * Constructor: GrammarRegistry
+   * ----------------------------
+   * Constructs an empty registry that isn't watching anything.
+   */
+
+  GrammarRegistry();
+
+  /**
+   * Destructor: ~GrammarRegistry
+   * ----------------------------
+   * Stops watching for changes, waiting for any reload that's under
+   * way to finish.
+   */
+
+  ~GrammarRegistry();
+
+  /**
+   * Method: loadFile
+   * ----------------
+   * Loads, checks, and analyzes the grammar in the named file, and
+   * registers it under the file's name (without any directories),
+   * replacing whatever was registered under that name before.
+   * Grammars that don't define <start>, or reference nonterminals they
+   * never define, or whose <start> can never finish, are rejected.
+   * Images are read rather than mapped, so a request that's still
+   * expanding a grammar is never disturbed by changes to its file.
+   *
+   * @param path the path to a text grammar or an image.
+   * @param error set to a description of the problem when the file is rejected.
+   * @return true if and only if the grammar was registered.
+   */
+
+  bool loadFile(const string& path, string& error);
+
+  /**
+   * Method: loadDirectory
+   * ---------------------
+   * Calls loadFile on every file in the named directory whose name
+   * ends in ".g", describing each one that's rejected on the supplied
+   * stream.
+   *
+   * @return the number of grammars registered, or -1 if the directory
+   *         couldn't be read.
+   */
+
+  int loadDirectory(const string& directory, ostream& log);
+
+  /**
+   * Method: watch
+   * -------------
+   * Starts a background thread that watches the named directory with
+   * inotify.  Whenever a ".g" file is written or moved into place, it's
+   * loaded again and swapped in; if the new version is rejected, the old
+   * one stays put.  Whenever one is deleted or moved away, it's dropped.
+   * Every change is described on the supplied stream, which must outlive
+   * the registry.  Only one directory can be watched at a time.
+   *
+   * @return true if and only if the directory is now being watched.
+   */
+
+  bool watch(const string& directory, ostream& log);
+
+  /**
+   * Method: find
+   * ------------
+   * Returns the grammar registered under the specified name, or an
+   * empty shared_ptr if there isn't one.
+   */
+
+  shared_ptr<const RegisteredGrammar> find(const string& name) const;
+
+  /**
+   * Method: getNames
+   * ----------------
+   * Fills the supplied vector with the name of every registered
+   * grammar, in sorted order.
+   */
+
+  void getNames(vector<string>& names) const;
+
+ private:
+  typedef map<string, shared_ptr<const RegisteredGrammar> > Table;
+
+  shared_ptr<const Table> table;  // only ever accessed with atomic_load and atomic_store
+  mutex updating;                 // held while a new table is being built
+  int inotify;                    // -1 unless a directory is being watched
+  int stopPipe[2];                // closing stopPipe[1] wakes the watcher up to quit
+  thread watcher;
+
+  void publish(const string& name, const shared_ptr<const RegisteredGrammar>& entry);
+  void watchEvents(string directory, ostream *log);
+
+  // marked as private so registries can't be copy constructed or copy
+  // assigned, since the watcher thread belongs to exactly one of them.
+  GrammarRegistry(const GrammarRegistry& original);
+  GrammarRegistry& operator=(const GrammarRegistry& rhs);
+};
+
+#endif // ! __registry__
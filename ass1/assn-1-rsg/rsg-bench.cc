@@ -0,0 +1,233 @@
+/**
+ * File: rsg-bench.cc
+ * ------------------
+ * Provides the implementation of rsg-bench, which measures how fast
+ * every grammar in a directory loads and expands, as a baseline for
+ * catching regressions in the loader (Definition and Production), the
+ * compiler, and the Expander.  Every grammar is benchmarked in a child
+ * process of its own, so that its peak resident set size (as reported
+ * by wait4's rusage) belongs to it alone and a grammar that crashes
+ * can't take the others with it.
+ *
+ * Each grammar is loaded and then expanded --count times with a fixed
+ * seed, exactly as rsg --count --seed would, but into memory rather than
+ * a file, and the whole thing is repeated --repeat times.  The fastest
+ * load and the fastest generation are reported, since they're the
+ * least disturbed by whatever else the machine is doing.  Sentences
+ * that grow past --max-length are abandoned and counted separately, so
+ * a grammar with a heavy tail can't hold the whole run hostage.
+ *
+ * The output is tab-separated, with a header line naming the columns,
+ * and one line per grammar:
+ *
+ *     grammar status load_ms sentences abandoned generate_ms
+ *     sentences_per_sec bytes bytes_per_sec peak_rss_kb
+ */
+
+#include "grammar.h"
+#include "loader.h"
+#include "analysis.h"
+#include "expander.h"
+#include "random.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+using namespace std;
+
+/**
+ * Struct: BenchOptions
+ * --------------------
+ * Bundles everything that can be specified on the command line.
+ */
+
+struct BenchOptions {
+  const char *directory;
+  long count;
+  uint64_t seed;
+  long repeat;
+  long maxLength;
+
+  BenchOptions() : directory("data"), count(10000), seed(1), repeat(3), maxLength(64 * 1024) {}
+};
+
+static double now()
+{
+  return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Function: benchmarkGrammar
+ * --------------------------
+ * Loads and expands the named grammar, repeatedly, and returns the
+ * tab-separated fields of its line that come before the peak RSS.
+ * This is what runs in each child process.
+ */
+
+static string benchmarkGrammar(const string& path, const BenchOptions& options)
+{
+  double bestLoad = HUGE_VAL, bestGenerate = HUGE_VAL;
+  long completed = 0, abandoned = 0;
+  uint64_t bytes = 0;
+  for (long run = 0; run < options.repeat; run++) {
+    double started = now();
+    Grammar grammar;
+    LoadStatus status = readGrammarFile(path, grammar);
+    if (status != kLoaded)
+      return status == kCorrupt ? "corrupt" : status == kMalformed ? "malformed" : "unreadable";
+    string problem;
+    int start = findStartSymbol(grammar, problem);
+    if (start == -1) return "incomplete";
+    bestLoad = min(bestLoad, now() - started);
+
+    GrammarAnalysis analysis(grammar, start);
+    if (!analysis.isProductive(start)) return "unproductive";
+    Expander expander(grammar);
+    expander.setMaxLength(options.maxLength);
+    RandomGenerator random;
+    string sentence;
+    completed = abandoned = 0;
+    bytes = 0;
+    started = now();
+    for (long i = 0; i < options.count; i++) {
+      random.setStream(options.seed, i);
+      if (expander.expand(start, random, sentence) == Expander::kComplete) {
+	completed++;
+	bytes += sentence.size() + 1;
+      } else {
+	abandoned++;
+      }
+    }
+    bestGenerate = min(bestGenerate, now() - started);
+  }
+
+  ostringstream fields;
+  fields << fixed;
+  fields.precision(3);
+  fields << "ok\t" << bestLoad * 1e3 << "\t" << completed << "\t" << abandoned << "\t"
+	 << bestGenerate * 1e3 << "\t" << completed / bestGenerate << "\t" << bytes << "\t"
+	 << bytes / bestGenerate;
+  return fields.str();
+}
+
+/**
+ * Function: runChild
+ * ------------------
+ * Benchmarks the named grammar in a child process, which hands its
+ * fields back through a pipe, and appends the child's peak RSS.  A
+ * child that dies instead is reported as having crashed.
+ */
+
+static string runChild(const string& path, const BenchOptions& options)
+{
+  int fds[2];
+  if (pipe(fds) == -1) return "failed";
+  cout.flush();
+  pid_t pid = fork();
+  if (pid == -1) {
+    close(fds[0]);
+    close(fds[1]);
+    return "failed";
+  }
+
+  if (pid == 0) {
+    close(fds[0]);
+    string fields = benchmarkGrammar(path, options);
+    ssize_t written = write(fds[1], fields.data(), fields.size());
+    _exit(written == static_cast<ssize_t>(fields.size()) ? 0 : 1);
+  }
+
+  close(fds[1]);
+  string fields;
+  char buffer[1024];
+  for (ssize_t received; (received = read(fds[0], buffer, sizeof(buffer))) != 0; ) {
+    if (received > 0) fields.append(buffer, received);
+    else if (errno != EINTR) break;
+  }
+  close(fds[0]);
+
+  int status;
+  struct rusage usage;
+  while (wait4(pid, &status, 0, &usage) == -1)
+    if (errno != EINTR) return "failed";
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) return "crashed";
+  if (fields.compare(0, 3, "ok\t") != 0) return fields;
+  return fields + "\t" + to_string(usage.ru_maxrss);
+}
+
+static void printUsage()
+{
+  cerr << "Usage: rsg-bench [--count N] [--seed S] [--repeat R] [--max-length L] [<directory of grammar files>]" << endl;
+}
+
+static bool parseOptions(int argc, char *argv[], BenchOptions& options)
+{
+  bool haveDirectory = false;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--count" && hasValue && atol(argv[i + 1]) > 0) {
+      options.count = atol(argv[++i]);
+    } else if (arg == "--seed" && hasValue) {
+      options.seed = strtoull(argv[++i], NULL, 10);
+    } else if (arg == "--repeat" && hasValue && atol(argv[i + 1]) > 0) {
+      options.repeat = atol(argv[++i]);
+    } else if (arg == "--max-length" && hasValue && atol(argv[i + 1]) > 0) {
+      options.maxLength = atol(argv[++i]);
+    } else if (arg[0] != '-' && !haveDirectory) {
+      options.directory = argv[i];
+      haveDirectory = true;
+    } else {
+      cerr << "Unrecognized or incomplete option \"" << arg << "\"." << endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Benchmarks every ".g" file in the directory, in sorted order.  Grammars
+ * that can't be benchmarked still get a line, with a status other than
+ * ok and no measurements, so the rows always line up with the directory.
+ * The exit status is 1 for a malformed command line, 2 if the directory
+ * can't be read, and 0 otherwise.
+ */
+
+int main(int argc, char *argv[])
+{
+  BenchOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    printUsage();
+    return 1;
+  }
+
+  DIR *dir = opendir(options.directory);
+  if (dir == NULL) {
+    cerr << "Failed to read the directory named \"" << options.directory << "\"." << endl;
+    return 2;
+  }
+  vector<string> fileNames;
+  for (struct dirent *entry = readdir(dir); entry != NULL; entry = readdir(dir)) {
+    string fileName = entry->d_name;
+    if (fileName.size() > 2 && fileName.compare(fileName.size() - 2, 2, ".g") == 0)
+      fileNames.push_back(fileName);
+  }
+  closedir(dir);
+  sort(fileNames.begin(), fileNames.end());
+
+  cout << "grammar\tstatus\tload_ms\tsentences\tabandoned\tgenerate_ms\tsentences_per_sec\t"
+       << "bytes\tbytes_per_sec\tpeak_rss_kb" << endl;
+  for (size_t i = 0; i < fileNames.size(); i++)
+    cout << fileNames[i] << "\t" << runChild(string(options.directory) + "/" + fileNames[i], options) << endl;
+  return 0;
+}
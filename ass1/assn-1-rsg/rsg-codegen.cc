@@ -0,0 +1,342 @@
+/**
+ * File: rsg-codegen.cc
+ * --------------------
+ * Provides the implementation of rsg-codegen, which compiles a
+ * grammar into the C++ source of a standalone generator for just that
+ * grammar.  Every nonterminal reachable from <start> becomes a function
+ * that switches on its chosen production, and every run of terminals
+ * within a production becomes a single string literal, so the generator
+ * parses nothing, looks nothing up, and leaves the compiler free to
+ * inline whatever it likes.  The generator links against nothing but
+ * random.o.
+ *
+ * The generated functions draw random numbers exactly as the Expander
+ * does (including the draw that picks among just one production), and
+ * their depth limit counts the same frames, so
+ *
+ *     <generator> --count N --seed S
+ *
+ * prints precisely what rsg --count N --seed S does on the same grammar.
+ * That holds even when some sentence exceeds the depth limit, since the
+ * generator, like rsg with a single thread, writes its sentences a whole
+ * block of kSentencesPerBlock at a time, and so never writes any of the
+ * block holding the failing sentence.
+ */
+
+#include "grammar.h"
+#include "loader.h"
+#include "expander.h"
+#include "bulk.h"
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+using namespace std;
+
+/**
+ * Function: quote
+ * ---------------
+ * Returns the specified text as a C++ string literal.  Anything that
+ * isn't printable ASCII is written as a three-digit octal escape, which
+ * can't run into whatever follows it.
+ */
+
+static string quote(const string& text)
+{
+  string literal = "\"";
+  for (size_t i = 0; i < text.size(); i++) {
+    unsigned char ch = text[i];
+    if (ch == '"' || ch == '\\') {
+      literal += '\\';
+      literal += ch;
+    } else if (ch < ' ' || ch > '~') {
+      char escape[5];
+      snprintf(escape, sizeof(escape), "\\%03o", ch);
+      literal += escape;
+    } else {
+      literal += ch;
+    }
+  }
+  return literal + "\"";
+}
+
+/**
+ * Function: getFunctionName
+ * -------------------------
+ * Returns the name of the function that expands the specified
+ * nonterminal.  The id keeps names distinct, and whatever of the
+ * nonterminal's own name is a valid identifier keeps them readable.
+ */
+
+static string getFunctionName(const Grammar& grammar, int id)
+{
+  string name = grammar.getNonterminal(id);
+  string function = "expand" + to_string(id) + "_";
+  for (size_t i = 1; i + 1 < name.size(); i++)
+    function += isalnum(static_cast<unsigned char>(name[i])) ? name[i] : '_';
+  return function;
+}
+
+/**
+ * Function: findReachable
+ * -----------------------
+ * Marks every nonterminal that can appear in some expansion of the
+ * start symbol.  Nothing else gets a function, since the compiler would
+ * only warn that it's never called.
+ */
+
+static void findReachable(const Grammar& grammar, int start, vector<bool>& reachable)
+{
+  reachable.assign(grammar.getNonterminalCount(), false);
+  vector<int> pending(1, start);
+  reachable[start] = true;
+  while (!pending.empty()) {
+    int id = pending.back();
+    pending.pop_back();
+    for (int p = grammar.beginProductions(id); p < grammar.endProductions(id); p++) {
+      for (const Grammar::symbol *s = grammar.beginSymbols(p); s < grammar.endSymbols(p); s++) {
+	int index = Grammar::indexOf(*s);
+	if (!Grammar::isNonterminal(*s) || reachable[index]) continue;
+	reachable[index] = true;
+	pending.push_back(index);
+      }
+    }
+  }
+}
+
+/**
+ * Function: writeProduction
+ * -------------------------
+ * Writes the statements that expand a single production.  Consecutive
+ * terminals are joined into one literal, separated by spaces just as
+ * the Expander would separate them.  A nonterminal in the middle of the
+ * production leaves the rest of the production pending, so it costs a
+ * level of depth; the last symbol doesn't, and is a tail call.
+ */
+
+static void writeProduction(ostream& out, const Grammar& grammar, int production)
+{
+  const Grammar::symbol *begin = grammar.beginSymbols(production);
+  const Grammar::symbol *end = grammar.endSymbols(production);
+  string run;
+  for (const Grammar::symbol *s = begin; s < end; s++) {
+    int index = Grammar::indexOf(*s);
+    if (!Grammar::isNonterminal(*s)) {
+      if (!run.empty()) run += ' ';
+      run.append(grammar.getTerminal(index), grammar.getTerminalLength(index));
+      continue;
+    }
+
+    if (!run.empty()) {
+      out << "    emit(text, " << quote(run) << ", " << run.size() << ");" << endl;
+      run.clear();
+    }
+    string function = getFunctionName(grammar, index);
+    if (s + 1 == end) {
+      out << "    return " << function << "(random, text, depth);" << endl;
+      return;
+    }
+    out << "    if (depth + 1 >= kMaxDepth || !" << function << "(random, text, depth + 1)) return false;" << endl;
+  }
+
+  if (!run.empty()) out << "    emit(text, " << quote(run) << ", " << run.size() << ");" << endl;
+  out << "    return true;" << endl;
+}
+
+/**
+ * Function: writeNonterminal
+ * --------------------------
+ * Writes the function for a single nonterminal.  Weighted nonterminals
+ * carry their alias tables along as static arrays.
+ */
+
+static void writeNonterminal(ostream& out, const Grammar& grammar, int id)
+{
+  int first = grammar.beginProductions(id);
+  int count = grammar.endProductions(id) - first;
+  out << "// " << grammar.getNonterminal(id) << endl;
+  out << "static bool " << getFunctionName(grammar, id)
+      << "(RandomGenerator& random, string& text, size_t depth)" << endl;
+  out << "{" << endl;
+  uint32_t totalWeight = grammar.getTotalWeight(id);
+  if (totalWeight == 0) {
+    out << "  uint32_t column = random.getRandomBelow(" << count << ");" << endl;
+  } else {
+    out << "  static const uint32_t accept[] = {";
+    for (int i = 0; i < count; i++) out << (i == 0 ? " " : ", ") << grammar.getAcceptThreshold(first + i);
+    out << " };" << endl;
+    out << "  static const uint32_t alias[] = {";
+    for (int i = 0; i < count; i++) out << (i == 0 ? " " : ", ") << grammar.getAlias(first + i);
+    out << " };" << endl;
+    out << "  uint32_t column = random.getRandomBelow(" << count << ");" << endl;
+    out << "  if (random.getRandomBelow(" << totalWeight << ") >= accept[column]) column = alias[column];" << endl;
+  }
+
+  out << "  switch (column) {" << endl;
+  for (int i = 0; i < count; i++) {
+    out << (i + 1 < count ? "  case " + to_string(i) + ":" : "  default:") << endl;
+    writeProduction(out, grammar, first + i);
+  }
+  out << "  }" << endl;
+  out << "}" << endl << endl;
+}
+
+/**
+ * Function: writeGenerator
+ * ------------------------
+ * Writes the complete source of the generator: a declaration of every
+ * function (since nonterminals refer to one another in every order),
+ * their definitions, and a main function that drives them.  Generation
+ * runs on a thread with a generous stack, since the nested calls can go
+ * as deep as the depth limit allows.
+ */
+
+static void writeGenerator(ostream& out, const Grammar& grammar, int start, const string& fileName)
+{
+  vector<bool> reachable;
+  findReachable(grammar, start, reachable);
+
+  out << "/**" << endl
+      << " * Generated by rsg-codegen from \"" << fileName << "\".  Do not edit." << endl
+      << " * Usage: <generator> [--count N] [--seed S]" << endl
+      << " */" << endl << endl
+      << "#include \"random.h\"" << endl
+      << "#include <iostream>" << endl
+      << "#include <string>" << endl
+      << "#include <pthread.h>" << endl
+      << "#include <stdio.h>" << endl
+      << "#include <stdlib.h>" << endl
+      << "#include <string.h>" << endl
+      << "using namespace std;" << endl << endl
+      << "static const size_t kMaxDepth = " << Expander::kDefaultMaxDepth << ";" << endl
+      << "static const size_t kStackSize = 1 << 30;" << endl
+      << "static const long kSentencesPerBlock = " << kSentencesPerBlock << ";" << endl << endl
+      << "static inline void emit(string& text, const char *words, size_t length)" << endl
+      << "{" << endl
+      << "  if (!text.empty()) text.push_back(' ');" << endl
+      << "  text.append(words, length);" << endl
+      << "}" << endl << endl;
+
+  for (int id = 0; id < grammar.getNonterminalCount(); id++)
+    if (reachable[id])
+      out << "static bool " << getFunctionName(grammar, id) << "(RandomGenerator& random, string& text, size_t depth);" << endl;
+  out << endl;
+  for (int id = 0; id < grammar.getNonterminalCount(); id++)
+    if (reachable[id]) writeNonterminal(out, grammar, id);
+
+  out << "struct Run {" << endl
+      << "  long count;" << endl
+      << "  uint64_t seed;" << endl
+      << "  long failed;" << endl
+      << "};" << endl << endl
+      << "static void *generate(void *arg)" << endl
+      << "{" << endl
+      << "  Run& run = *static_cast<Run *>(arg);" << endl
+      << "  RandomGenerator random;" << endl
+      << "  string sentence, buffer;" << endl
+      << "  for (long i = 0; i < run.count; i++) {" << endl
+      << "    random.setStream(run.seed, i);" << endl
+      << "    sentence.clear();" << endl
+      << "    if (!" << getFunctionName(grammar, start) << "(random, sentence, 0)) {" << endl
+      << "      run.failed = i;" << endl
+      << "      return NULL;" << endl
+      << "    }" << endl
+      << "    buffer += sentence;" << endl
+      << "    buffer += '\\n';" << endl
+      << "    if ((i + 1) % kSentencesPerBlock == 0) {" << endl
+      << "      fwrite(buffer.data(), 1, buffer.size(), stdout);" << endl
+      << "      buffer.clear();" << endl
+      << "    }" << endl
+      << "  }" << endl
+      << "  fwrite(buffer.data(), 1, buffer.size(), stdout);" << endl
+      << "  return NULL;" << endl
+      << "}" << endl << endl
+      << "int main(int argc, char *argv[])" << endl
+      << "{" << endl
+      << "  Run run = { 1, RandomGenerator().getRandomBits(), -1 };" << endl
+      << "  for (int i = 1; i < argc; i++) {" << endl
+      << "    if (strcmp(argv[i], \"--count\") == 0 && i + 1 < argc) run.count = atol(argv[++i]);" << endl
+      << "    else if (strcmp(argv[i], \"--seed\") == 0 && i + 1 < argc) run.seed = strtoull(argv[++i], NULL, 10);" << endl
+      << "    else {" << endl
+      << "      cerr << \"Usage: \" << argv[0] << \" [--count N] [--seed S]\" << endl;" << endl
+      << "      return 1;" << endl
+      << "    }" << endl
+      << "  }" << endl << endl
+      << "  pthread_attr_t attributes;" << endl
+      << "  pthread_attr_init(&attributes);" << endl
+      << "  pthread_attr_setstacksize(&attributes, kStackSize);" << endl
+      << "  pthread_t generator;" << endl
+      << "  if (pthread_create(&generator, &attributes, generate, &run) != 0) return 4;" << endl
+      << "  pthread_join(generator, NULL);" << endl
+      << "  if (fflush(stdout) != 0) return 4;" << endl
+      << "  if (run.failed != -1) {" << endl
+      << "    cerr << \"Sentence \" << run.failed << \" exceeded the maximum depth.\" << endl;" << endl
+      << "    return 4;" << endl
+      << "  }" << endl
+      << "  return 0;" << endl
+      << "}" << endl;
+}
+
+static void printUsage()
+{
+  cerr << "Usage: rsg-codegen <path to grammar text file or image> [-o <output file>]" << endl;
+}
+
+/**
+ * Loads and checks the grammar, then writes its generator to the
+ * output file (or to standard output).  The exit status follows rsg's:
+ * 1 for a malformed command line, 2 for a file that can't be read or
+ * written, and 3 for a grammar that's incomplete or corrupt.
+ */
+
+int main(int argc, char *argv[])
+{
+  const char *grammarFileName = NULL;
+  const char *outputFileName = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      outputFileName = argv[++i];
+    } else if (argv[i][0] != '-' && grammarFileName == NULL) {
+      grammarFileName = argv[i];
+    } else {
+      printUsage();
+      return 1;
+    }
+  }
+  if (grammarFileName == NULL) {
+    printUsage();
+    return 1;
+  }
+
+  Grammar grammar;
+  LoadStatus status = readGrammarFile(grammarFileName, grammar);
+  if (status != kLoaded) {
+    cerr << "The grammar file called \"" << grammarFileName << "\" "
+	 << (status == kCorrupt ? "is corrupt or truncated." :
+	     status == kMalformed ? "is malformed." : "couldn't be opened.") << endl;
+    return status == kUnreadable ? 2 : 3;
+  }
+
+  string problem;
+  int start = findStartSymbol(grammar, problem);
+  if (start == -1) {
+    cerr << "The grammar file called \"" << grammarFileName << "\" " << problem << "." << endl;
+    return 3;
+  }
+
+  if (outputFileName == NULL) {
+    writeGenerator(cout, grammar, start, grammarFileName);
+    return cout.flush() ? 0 : 2;
+  }
+
+  ofstream out(outputFileName);
+  writeGenerator(out, grammar, start, grammarFileName);
+  out.close();
+  if (!out) {
+    cerr << "Failed to write \"" << outputFileName << "\"." << endl;
+    return 2;
+  }
+  return 0;
+}
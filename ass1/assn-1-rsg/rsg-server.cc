@@ -0,0 +1,478 @@
+/**
+ * File: rsg-server.cc
+ * -------------------
+ * Provides the implementation of rsg-server, a long-running process
+ * that preloads every grammar in a directory and then generates
+ * sentences on request over a Unix domain socket, so clients pay for
+ * neither process startup nor parsing.  The protocol is line-based.
+ * Each request is a single line:
+ *
+ *     GENERATE <grammar file name> <count> <seed>
+ *     LIST
+ *
+ * and each response is a series of chunks, each of which is a line
+ * reading LINES k followed by k lines of text, terminated by a line
+ * reading END, or else by a line reading ERR and a description of the
+ * problem.  GENERATE responds with count sentences, identical to the
+ * output of rsg --count <count> --seed <seed> on the same grammar, and
+ * LIST with the names of the grammars that are loaded.
+ *
+ * Clients may pipeline requests, sending as many as they like before
+ * reading any responses; responses always come back in request order.
+ * Every connection has a reader thread, which parses requests and
+ * splits each GENERATE into blocks of sentences, and a writer thread,
+ * which writes each block out in order as soon as it's ready.  The
+ * blocks themselves are generated by a fixed pool of worker threads
+ * shared by every connection, so a large request keeps all of the
+ * workers busy while a small one still gets its turn.
+ *
+ * The grammar directory is watched for changes, and a grammar whose
+ * file is rewritten is reloaded in the background and swapped in
+ * between requests.  A request always finishes with the grammar it
+ * started with.
+ */
+
+#include "registry.h"
+#include "bulk.h"
+#include "expander.h"
+#include "gather.h"
+#include "random.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+using namespace std;
+
+static const size_t kMaxOutstanding = 64;
+static const size_t kMaxRequestLength = 4096;
+
+struct Connection;
+
+/**
+ * Struct: Request
+ * ---------------
+ * Shared by every block of a single GENERATE request.  The first
+ * block that hits an Expander limit sets failed, so that blocks that
+ * haven't been started yet aren't generated for nothing.
+ */
+
+struct Request {
+  shared_ptr<const RegisteredGrammar> grammar;
+  uint64_t seed;
+  atomic<bool> failed;
+
+  Request(const shared_ptr<const RegisteredGrammar>& grammar, uint64_t seed) :
+    grammar(grammar), seed(seed), failed(false) {}
+};
+
+/**
+ * Struct: Job
+ * -----------
+ * One chunk of some connection's responses.  A job with a request is
+ * a block of sentences [first, last) that a worker fills in; a job
+ * without one is a message that's ready as soon as it's queued.  The
+ * pieces point into the grammar's string pool, which the request keeps
+ * alive, and into message.  fatal marks the block whose failure ended
+ * its response.  done is guarded by the connection's lock.
+ */
+
+struct Job {
+  shared_ptr<Connection> connection;
+  shared_ptr<Request> request;
+  long first;
+  long last;
+  string message;
+  GatherWriter pieces;
+  bool fatal;
+  bool done;
+
+  Job(const shared_ptr<Connection>& connection) :
+    connection(connection), first(0), last(0), fatal(false), done(false) {}
+};
+
+/**
+ * Struct: Connection
+ * ------------------
+ * Everything a connection's reader and writer threads share.  outgoing
+ * holds the jobs whose responses haven't been written yet, in request
+ * order.  The reader waits whenever it's kMaxOutstanding jobs ahead of
+ * the writer, so a client that never reads can't make the server buffer
+ * without bound.  Once broken is set, the client is gone and nothing
+ * more is generated or written.
+ */
+
+struct Connection {
+  int fd;
+  mutex lock;
+  condition_variable changed;
+  deque<shared_ptr<Job> > outgoing;
+  bool reading;
+  atomic<bool> broken;
+
+  Connection(int fd) : fd(fd), reading(true), broken(false) {}
+};
+
+/**
+ * Struct: WorkQueue
+ * -----------------
+ * The blocks waiting for a worker, across every connection.
+ */
+
+struct WorkQueue {
+  mutex lock;
+  condition_variable available;
+  deque<shared_ptr<Job> > jobs;
+};
+
+/**
+ * Struct: ServerOptions
+ * ---------------------
+ * Bundles everything that can be specified on the command line.
+ */
+
+struct ServerOptions {
+  const char *directory;
+  const char *socketPath;
+  int threads;
+
+  ServerOptions() : directory(NULL), socketPath("rsg.sock"), threads(thread::hardware_concurrency()) {}
+};
+
+/**
+ * Function: generateBlock
+ * -----------------------
+ * Fills in a block's pieces with its LINES header and sentences,
+ * keying the generator on each sentence's number exactly as
+ * generateBulk does.  If a sentence hits a limit, the block's pieces are
+ * replaced with an ERR line instead.
+ */
+
+static void generateBlock(Job& job)
+{
+  Request& request = *job.request;
+  if (request.failed || job.connection->broken) return;
+  const RegisteredGrammar& entry = *request.grammar;
+  Expander expander(entry.grammar);
+  RandomGenerator random;
+  job.message = "LINES " + to_string(job.last - job.first) + "\n";
+  job.pieces.append(job.message.data(), job.message.size());
+  for (long i = job.first; i < job.last; i++) {
+    random.setStream(request.seed, i);
+    Expander::Outcome outcome = expander.expand(entry.start, random, job.pieces);
+    if (outcome != Expander::kComplete) {
+      request.failed = true;
+      job.fatal = true;
+      job.message = "ERR Sentence " + to_string(i) + " exceeded the maximum " +
+	(outcome == Expander::kTooDeep ? "depth" : "length") + ".\n";
+      job.pieces.clear();
+      job.pieces.append(job.message.data(), job.message.size());
+      return;
+    }
+    job.pieces.push_back('\n');
+  }
+}
+
+/**
+ * Function: work
+ * --------------
+ * The body of each worker thread, which generates blocks forever.
+ */
+
+static void work(WorkQueue& queue)
+{
+  while (true) {
+    shared_ptr<Job> job;
+    {
+      unique_lock<mutex> guard(queue.lock);
+      while (queue.jobs.empty()) queue.available.wait(guard);
+      job = queue.jobs.front();
+      queue.jobs.pop_front();
+    }
+
+    generateBlock(*job);
+    Connection& connection = *job->connection;
+    lock_guard<mutex> guard(connection.lock);
+    job->done = true;
+    connection.changed.notify_all();
+  }
+}
+
+/**
+ * Function: enqueue
+ * -----------------
+ * Appends a job to its connection's outgoing queue, waiting first if
+ * the connection already has kMaxOutstanding jobs in flight, and then
+ * hands it to the workers if it still needs generating.
+ */
+
+static void enqueue(const shared_ptr<Job>& job, WorkQueue& queue)
+{
+  Connection& connection = *job->connection;
+  {
+    unique_lock<mutex> guard(connection.lock);
+    while (connection.outgoing.size() >= kMaxOutstanding) connection.changed.wait(guard);
+    connection.outgoing.push_back(job);
+  }
+
+  if (job->done) return;
+  lock_guard<mutex> guard(queue.lock);
+  queue.jobs.push_back(job);
+  queue.available.notify_one();
+}
+
+static void sendMessage(const shared_ptr<Connection>& connection, const string& message, WorkQueue& queue)
+{
+  shared_ptr<Job> job(new Job(connection));
+  job->message = message;
+  job->pieces.append(job->message.data(), job->message.size());
+  job->done = true;
+  enqueue(job, queue);
+}
+
+/**
+ * Function: handleRequest
+ * -----------------------
+ * Parses a single request line and queues up the jobs that answer it.
+ */
+
+static void handleRequest(const shared_ptr<Connection>& connection, const string& line,
+			  const GrammarRegistry& registry, WorkQueue& queue)
+{
+  istringstream tokens(line);
+  string command, name, extra;
+  long count;
+  uint64_t seed;
+  tokens >> command;
+  if (command == "LIST" && !(tokens >> extra)) {
+    vector<string> names;
+    registry.getNames(names);
+    string message = "LINES " + to_string(names.size()) + "\n";
+    for (size_t i = 0; i < names.size(); i++) message += names[i] + "\n";
+    sendMessage(connection, message + "END\n", queue);
+    return;
+  }
+
+  if (command != "GENERATE" || !(tokens >> name >> count >> seed) || (tokens >> extra) || count <= 0) {
+    sendMessage(connection, "ERR Expected GENERATE <grammar> <count> <seed> or LIST.\n", queue);
+    return;
+  }
+
+  shared_ptr<const RegisteredGrammar> grammar = registry.find(name);
+  if (!grammar) {
+    sendMessage(connection, "ERR There's no grammar called \"" + name + "\".\n", queue);
+    return;
+  }
+
+  shared_ptr<Request> request(new Request(grammar, seed));
+  for (long first = 0; first < count && !connection->broken; first += kSentencesPerBlock) {
+    shared_ptr<Job> job(new Job(connection));
+    job->request = request;
+    job->first = first;
+    job->last = min(first + kSentencesPerBlock, count);
+    enqueue(job, queue);
+  }
+
+  shared_ptr<Job> end(new Job(connection));
+  end->request = request;
+  end->message = "END\n";
+  end->pieces.append(end->message.data(), end->message.size());
+  end->done = true;
+  enqueue(end, queue);
+}
+
+/**
+ * Function: readRequests
+ * ----------------------
+ * The body of each connection's reader thread.  Requests are split
+ * out of whatever the client sends, one per line, until the client
+ * closes its end or sends a line that's unreasonably long.
+ */
+
+static void readRequests(shared_ptr<Connection> connection, const GrammarRegistry& registry, WorkQueue& queue)
+{
+  string buffer;
+  char chunk[4096];
+  while (!connection->broken) {
+    ssize_t received = read(connection->fd, chunk, sizeof(chunk));
+    if (received < 0 && errno == EINTR) continue;
+    if (received <= 0) break;
+    buffer.append(chunk, received);
+
+    size_t start = 0;
+    for (size_t newline = buffer.find('\n'); newline != string::npos; newline = buffer.find('\n', start)) {
+      handleRequest(connection, buffer.substr(start, newline - start), registry, queue);
+      start = newline + 1;
+    }
+    buffer.erase(0, start);
+    if (buffer.size() > kMaxRequestLength) {
+      sendMessage(connection, "ERR Request too long.\n", queue);
+      break;
+    }
+  }
+
+  lock_guard<mutex> guard(connection->lock);
+  connection->reading = false;
+  connection->changed.notify_all();
+}
+
+/**
+ * Function: writeResponses
+ * ------------------------
+ * The body of each connection's writer thread.  Jobs are written in
+ * the order they were queued, each as soon as it's done.  Once a block
+ * reports an error, the rest of that request's jobs are dropped, since
+ * its response has already been terminated.  If the client goes away,
+ * the socket is shut down, which also stops the reader, and the
+ * remaining jobs are drained without being written.  The connection is
+ * closed once the reader has stopped and every job is accounted for.
+ */
+
+static void writeResponses(shared_ptr<Connection> connection)
+{
+  shared_ptr<Request> abandoned;
+  while (true) {
+    shared_ptr<Job> job;
+    {
+      unique_lock<mutex> guard(connection->lock);
+      while ((connection->outgoing.empty() || !connection->outgoing.front()->done) &&
+	     (connection->reading || !connection->outgoing.empty()))
+	connection->changed.wait(guard);
+      if (connection->outgoing.empty()) break;
+      job = connection->outgoing.front();
+      connection->outgoing.pop_front();
+      connection->changed.notify_all();
+    }
+
+    if (connection->broken || (job->request && job->request == abandoned)) continue;
+    if (job->fatal) abandoned = job->request;
+    if (!job->pieces.write(connection->fd)) {
+      connection->broken = true;
+      shutdown(connection->fd, SHUT_RDWR);
+    }
+  }
+
+  close(connection->fd);
+}
+
+static void printUsage()
+{
+  cerr << "Usage: rsg-server [--socket <path>] [--threads T] <directory of grammar files>" << endl;
+}
+
+static bool parseOptions(int argc, char *argv[], ServerOptions& options)
+{
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--socket" && hasValue) {
+      options.socketPath = argv[++i];
+    } else if (arg == "--threads" && hasValue && atoi(argv[i + 1]) > 0) {
+      options.threads = atoi(argv[++i]);
+    } else if (arg[0] != '-' && options.directory == NULL) {
+      options.directory = argv[i];
+    } else {
+      cerr << "Unrecognized or incomplete option \"" << arg << "\"." << endl;
+      return false;
+    }
+  }
+
+  if (options.directory == NULL) {
+    cerr << "You need to specify a directory of grammar files." << endl;
+    return false;
+  }
+
+  if (options.threads <= 0) options.threads = 1;
+  return true;
+}
+
+/**
+ * Function: listen
+ * ----------------
+ * Creates the listening socket at the specified path, replacing a
+ * stale socket left behind by an earlier server (but never any other
+ * kind of file).  Returns the socket, or -1 after printing a message.
+ */
+
+static int listenAt(const char *path)
+{
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    cerr << "The socket path \"" << path << "\" is too long." << endl;
+    return -1;
+  }
+  strcpy(address.sun_path, path);
+
+  struct stat info;
+  if (lstat(path, &info) == 0 && S_ISSOCK(info.st_mode)) unlink(path);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1 || bind(fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) == -1 ||
+      listen(fd, SOMAXCONN) == -1) {
+    cerr << "Failed to listen on \"" << path << "\": " << strerror(errno) << "." << endl;
+    if (fd != -1) close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/**
+ * Loads the grammars, starts the workers, and then accepts connections
+ * forever, starting a reader and a writer for each one.  The exit status
+ * is 1 for a malformed command line and 2 if the directory can't be
+ * read or the socket can't be created.
+ */
+
+int main(int argc, char *argv[])
+{
+  ServerOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    printUsage();
+    return 1;
+  }
+
+  GrammarRegistry registry;
+  int loaded = registry.loadDirectory(options.directory, cerr);
+  if (loaded == -1) {
+    cerr << "Failed to read the directory named \"" << options.directory << "\"." << endl;
+    return 2;
+  }
+
+  if (!registry.watch(options.directory, cerr))
+    cerr << "Failed to watch \"" << options.directory << "\", so changes won't be picked up." << endl;
+
+  signal(SIGPIPE, SIG_IGN); // failed writes are reported through errno instead
+  int server = listenAt(options.socketPath);
+  if (server == -1) return 2;
+  cerr << "Serving " << loaded << " grammars on \"" << options.socketPath << "\" with "
+       << options.threads << " workers." << endl;
+
+  WorkQueue queue;
+  for (int i = 0; i < options.threads; i++)
+    thread(work, ref(queue)).detach();
+
+  while (true) {
+    int fd = accept(server, NULL, NULL);
+    if (fd == -1) {
+      if (errno != EINTR && errno != ECONNABORTED) cerr << "accept failed: " << strerror(errno) << endl;
+      continue;
+    }
+
+    shared_ptr<Connection> connection(new Connection(fd));
+    thread(readRequests, connection, cref(registry), ref(queue)).detach();
+    thread(writeResponses, connection).detach();
+  }
+}
@@ -4,96 +4,514 @@
  * Provides the implementation of the full RSG application, which
  * relies on the services of the built-in string, ifstream, vector,
  * and map classes as well as the custom Production and Definition
- * classes provided with the assignment.
+ * classes provided with the assignment (by way of loader.h).
  */
  
-#include <map>
+#include <memory>
 #include <fstream>
-#include "definition.h"
-#include "production.h"
+#include <sstream>
+#include "grammar.h"
+#include "loader.h"
+#include "random.h"
+#include "bulk.h"
+#include "expander.h"
+#include "analysis.h"
+#include "derivations.h"
+#include "lengths.h"
+#include "profile.h"
+#include "feeds.h"
+#include <stdlib.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <iomanip>
+#include <time.h>
 using namespace std;
 
+static const long kProfileSentences = 1000;
+
+/**
+ * Struct: RSGOptions
+ * ------------------
+ * Bundles everything that can be specified on the command line.
+ * When count is 0, rsg behaves as it always has and prints three
+ * numbered versions.  Otherwise it generates count sentences in bulk,
+ * one per line, with no header.  Unless --seed is given, the seed is
+ * taken from the current time.  With --compile, nothing is generated
+ * and the compiled image is written to the output file instead.  With
+ * --analyze, nothing is generated and the grammar's analysis is printed.
+ * With --derivations, nothing is generated and the number of derivations
+ * of <start> of every length up to the given number of words is printed.
+ * With --words, every sentence is drawn uniformly from the derivations
+ * of <start> with exactly that many words, so the Expander's limits
+ * (--max-depth, --max-length, and --max-chars) don't apply and are
+ * refused.  With --unique, repeated
+ * sentences are dropped, and count distinct ones are generated, using
+ * at most --unique-memory megabytes to remember them.  With --rss,
+ * count RSS items are spread across that many feeds, which are written
+ * (along with a feeds list) into the directory named by -o.  With --profile (or
+ * --profile-json), the sentences are generated but not printed, and
+ * a profile of where the work went is printed instead.
+ */
+
+struct RSGOptions {
+  const char *grammarFileName;
+  const char *outputFileName;
+  bool seeded;
+  bool compile;
+  bool analyze;
+  bool profile;
+  bool profileJSON;
+  int derivations;
+  int feeds;
+  BulkOptions bulk;
+
+  RSGOptions() : grammarFileName(NULL), outputFileName(NULL), seeded(false), compile(false),
+    analyze(false), profile(false), profileJSON(false), derivations(0), feeds(0) {}
+};
+
+static void printUsage()
+{
+  cerr << "Usage: rsg [--count N] [--threads T] [--unordered] [--seed S] "
+       << "[--max-depth D] [--max-length L] [--max-chars C] [--words W] "
+       << "[--unique [--unique-memory MB]] [-o <output file>] "
+       << "<path to grammar text file or image>" << endl;
+  cerr << "       rsg --rss F --count N [--threads T] [--seed S] -o <directory> <path to grammar text file or image>" << endl;
+  cerr << "       rsg --compile <path to grammar text file> -o <image file>" << endl;
+  cerr << "       rsg --analyze <path to grammar text file or image>" << endl;
+  cerr << "       rsg --derivations W <path to grammar text file or image>" << endl;
+  cerr << "       rsg --profile [--profile-json] [--count N] [--seed S] <path to grammar text file or image>" << endl;
+}
+
+/**
+ * Parses a positive integer command line argument, returning false
+ * if the text isn't entirely made up of digits or if the value is 0.
+ */
+
+static bool parsePositive(const char *text, long& value)
+{
+  char *end;
+  value = strtol(text, &end, 10);
+  return *text != '\0' && *end == '\0' && value > 0;
+}
+
 /**
- * Takes a reference to a legitimate infile (one that's been set up
- * to layer over a file) and populates the grammar map with the
- * collection of definitions that are spelled out in the referenced
- * file.  The function is written under the assumption that the
- * referenced data file is really a grammar file that's properly
- * formatted.  You may assume that all grammars are in fact properly
- * formatted.
+ * Parses an unsigned 64-bit command line argument (zero is allowed),
+ * returning false if the text isn't entirely made up of digits.
+ */
+
+static bool parseSeed(const char *text, uint64_t& value)
+{
+  char *end;
+  value = strtoull(text, &end, 10);
+  return *text >= '0' && *text <= '9' && *end == '\0';
+}
+
+/**
+ * Populates the supplied RSGOptions from the command line, returning
+ * false (after printing a message) if the command line is malformed.
+ */
+
+static bool parseOptions(int argc, char *argv[], RSGOptions& options)
+{
+  bool limited = false; // whether any of the Expander's limits were given
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    long value;
+    if (arg == "--count" && hasValue && parsePositive(argv[i + 1], value)) {
+      options.bulk.count = value;
+      i++;
+    } else if (arg == "--threads" && hasValue && parsePositive(argv[i + 1], value)) {
+      options.bulk.threads = value;
+      i++;
+    } else if (arg == "--seed" && hasValue && parseSeed(argv[i + 1], options.bulk.seed)) {
+      options.seeded = true;
+      i++;
+    } else if (arg == "--max-depth" && hasValue && parsePositive(argv[i + 1], value)) {
+      options.bulk.maxDepth = value;
+      limited = true;
+      i++;
+    } else if (arg == "--max-length" && hasValue && parsePositive(argv[i + 1], value)) {
+      options.bulk.maxLength = value;
+      limited = true;
+      i++;
+    } else if (arg == "--max-chars" && hasValue && parsePositive(argv[i + 1], value) &&
+	       static_cast<size_t>(value) <= LengthDistribution::kMaxChars) {
+      options.bulk.maxChars = value;
+      limited = true;
+      i++;
+    } else if (arg == "--words" && hasValue && parsePositive(argv[i + 1], value) &&
+	       value <= DerivationCounter::kMaxWords) {
+      options.bulk.words = value;
+      i++;
+    } else if (arg == "--derivations" && hasValue && parsePositive(argv[i + 1], value) &&
+	       value <= DerivationCounter::kMaxWords) {
+      options.derivations = value;
+      i++;
+    } else if (arg == "--analyze") {
+      options.analyze = true;
+    } else if (arg == "--profile") {
+      options.profile = true;
+    } else if (arg == "--profile-json") {
+      options.profile = options.profileJSON = true;
+    } else if (arg == "--compile") {
+      options.compile = true;
+    } else if (arg == "--unordered") {
+      options.bulk.ordered = false;
+    } else if (arg == "--unique") {
+      options.bulk.unique = true;
+    } else if (arg == "--unique-memory" && hasValue && parsePositive(argv[i + 1], value) &&
+	       static_cast<unsigned long>(value) <= (SIZE_MAX >> 20)) {
+      options.bulk.uniqueMemory = static_cast<size_t>(value) << 20;
+      i++;
+    } else if (arg == "--rss" && hasValue && parsePositive(argv[i + 1], value)) {
+      options.feeds = value;
+      i++;
+    } else if (arg == "-o" && hasValue) {
+      options.outputFileName = argv[++i];
+    } else if (arg[0] != '-' && options.grammarFileName == NULL) {
+      options.grammarFileName = argv[i];
+    } else {
+      cerr << "Unrecognized or incomplete option \"" << arg << "\"." << endl;
+      return false;
+    }
+  }
+  
+  if (options.grammarFileName == NULL) {
+    cerr << "You need to specify the name of a grammar file." << endl;
+    return false;
+  }
+  
+  if (options.compile && options.outputFileName == NULL) {
+    cerr << "You need to name the image file with -o when using --compile." << endl;
+    return false;
+  }
+  
+  if (options.profile && (options.bulk.words > 0 || options.bulk.maxChars != string::npos)) {
+    cerr << "--profile can't be combined with --words or --max-chars." << endl;
+    return false;
+  }
+  
+  if (options.bulk.words > 0 && limited) {
+    cerr << "--words can't be combined with --max-depth, --max-length, or --max-chars." << endl;
+    return false;
+  }
+  
+  if (options.bulk.unique && (options.bulk.count == 0 || options.profile)) {
+    cerr << "--unique needs --count, and can't be combined with --profile." << endl;
+    return false;
+  }
+  
+  if (options.feeds > 0 && (options.bulk.count == 0 || options.outputFileName == NULL ||
+			    options.bulk.unique || options.profile)) {
+    cerr << "--rss needs --count and a directory named with -o, and can't be combined with --unique or --profile." << endl;
+    return false;
+  }
+  
+  if (!options.seeded) options.bulk.seed = time(NULL);
+  return true;
+}
+
+/**
+ * Populates the supplied Grammar from the named file, which may either
+ * be a text grammar or an image written by rsg --compile, printing a
+ * message if it can't be loaded.
  *
- * @param infile a valid reference to a flat text file storing the grammar.
- * @param grammar a reference to the STL map, which maps nonterminal strings
- *                to their definitions.
+ * @param grammarFileName the name of the grammar file or image.
+ * @param grammar the Grammar to be replaced by the file's contents.
+ * @return 0 on success, or the value main should return on failure.
  */
 
-static void readGrammar(ifstream& infile, map<string, Definition>& grammar)
+static int loadGrammar(const char *grammarFileName, Grammar& grammar)
 {
-  while (true) {
-    string uselessText;
-    getline(infile, uselessText, '{');
-    if (infile.eof()) return;  // true? we encountered EOF before we saw a '{': no more productions!
-    infile.putback('{');
-    Definition def(infile);
-    grammar[def.getNonterminal()] = def;
+  switch (readGrammarFile(grammarFileName, grammar)) {
+  case kLoaded:
+    return 0;
+  case kCorrupt:
+    cerr << "The grammar image called \"" << grammarFileName << "\" is corrupt or truncated." << endl;
+    return 3;
+  case kMalformed:
+    cerr << "The grammar file called \"" << grammarFileName << "\" is malformed: "
+	 << "some nonterminal's production weights add up to more than " << UINT32_MAX << "." << endl;
+    return 3;
+  default:
+    cerr << "Failed to open the file named \"" << grammarFileName << "\".  Check to ensure the file exists. " << endl;
+    return 2; // each bad thing has its own bad return value
   }
 }
 
-//void to generate and print random grammar text
-void getText(map<string, Definition> grammar, string start)
+/**
+ * Confirms that the grammar defines <start> and every nonterminal it
+ * references, returning the id of <start> or -1 (after printing a
+ * message) if it doesn't.
+ */
+
+static int findStart(const char *grammarFileName, const Grammar& grammar)
+{
+  string problem;
+  int start = findStartSymbol(grammar, problem);
+  if (start == -1)
+    cerr << "The grammar file called \"" << grammarFileName << "\" " << problem << "." << endl;
+  return start;
+}
+
+/**
+ * Generates options.bulk.count sentences, one per line, to the file
+ * named by -o or to standard out.  The sentences are written with
+ * writev rather than through an ostream, so the file is opened with
+ * open rather than as an ofstream.
+ *
+ * @return 0 on success, or the value main should return on failure.
+ */
+
+static int generateSentences(const Grammar& grammar, const GrammarAnalysis& analysis, int start,
+			     const RSGOptions& options)
 {
-  Production prod = grammar[start].getRandomProduction();
-  for(Production::iterator curr = prod.begin(); curr != prod.end(); ++curr) {
-    string currText = *curr;
-    if(currText.at(0)=='<')
-      getText(grammar, currText);
-    else
-      cout<<" "<<currText;
+  int fd = STDOUT_FILENO;
+  if (options.outputFileName != NULL) {
+    fd = open(options.outputFileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+      cerr << "Failed to open the file named \"" << options.outputFileName << "\" for writing." << endl;
+      return 2;
+    }
   }
+  
+  string error;
+  bool generated = generateBulk(grammar, analysis, start, options.bulk, fd, error);
+  if (fd != STDOUT_FILENO && close(fd) == -1 && generated) {
+    generated = false;
+    error = "Failed to write all of the generated sentences.";
+  }
+  if (!generated) {
+    cerr << error << endl;
+    return 4;
+  }
+  
+  return 0;
+}
+
+/**
+ * Writes options.bulk.count RSS items, spread across options.feeds
+ * feeds in the directory named by -o, and titled after the grammar
+ * file (without its directory or its ".g").
+ */
+
+static int generateRSS(const Grammar& grammar, const GrammarAnalysis& analysis, int start,
+		       const RSGOptions& options)
+{
+  string name = options.grammarFileName;
+  name = name.substr(name.find_last_of('/') + 1);
+  if (name.size() > 2 && name.compare(name.size() - 2, 2, ".g") == 0) name.erase(name.size() - 2);
+  
+  string error;
+  if (!generateFeeds(grammar, analysis, start, options.bulk, options.outputFileName,
+		     options.feeds, name, error)) {
+    cerr << error << endl;
+    return 4;
+  }
+  
+  return 0;
+}
+
+/**
+ * Prints the number of derivations of <start> with each number of words
+ * from 0 through the counter's bound, both exactly (or "-" once the count
+ * no longer fits in 64 bits) and approximately.
+ */
+
+static void printDerivations(const DerivationCounter& derivations, int start)
+{
+  cout << setw(8) << "words" << setw(22) << "derivations" << setw(16) << "approximately" << endl;
+  for (int words = 0; words <= derivations.getMaxWords(); words++) {
+    cout << setw(8) << words;
+    if (derivations.getCount(start, words) == DerivationCounter::kSaturated) cout << setw(22) << "-";
+    else cout << setw(22) << derivations.getCount(start, words);
+    DerivationCounter::Approximate approximate = derivations.getApproximateCount(start, words);
+    if (derivations.isInfinite(start, words)) {
+      cout << setw(16) << "infinite" << endl;
+    } else if (approximate.exponent == 0) {
+      cout << setw(16) << setprecision(6) << approximate.mantissa << endl;
+    } else {
+      double digits = floor(DerivationCounter::getLog10(approximate));
+      double leading = pow(10.0, DerivationCounter::getLog10(approximate) - digits);
+      ostringstream text;
+      text << setprecision(6) << leading << "e+" << static_cast<long>(digits);
+      cout << setw(16) << text.str() << endl;
+    }
+  }
+}
+
+/**
+ * Expands options.bulk.count sentences (or kProfileSentences if no
+ * count was given) on the calling thread, numbered and seeded exactly as
+ * generateBulk would, and prints their profile instead of the sentences.
+ * If one hits a limit, the profile of everything up to that point is
+ * still printed.
+ *
+ * @return 0 on success, or the value main should return on failure.
+ */
+
+static int profileSentences(const Grammar& grammar, int start, const RSGOptions& options)
+{
+  GrammarProfiler profiler(grammar);
+  profiler.setMaxDepth(options.bulk.maxDepth);
+  profiler.setMaxLength(options.bulk.maxLength);
+  long count = options.bulk.count > 0 ? options.bulk.count : kProfileSentences;
+  RandomGenerator random;
+  string sentence;
+  int status = 0;
+  for (long i = 0; i < count; i++) {
+    random.setStream(options.bulk.seed, i);
+    if (profiler.expand(start, random, sentence) != Expander::kComplete) {
+      cerr << "Sentence " << i << " exceeded the maximum depth or length." << endl;
+      status = 4;
+      break;
+    }
+  }
+  
+  if (options.profileJSON) profiler.printJSON(cout);
+  else profiler.print(cout);
+  return status;
+}
+
+/**
+ * Prints the number of definitions followed by three
+ * randomly generated sentences, as the original RSG always has.
+ *
+ * @return 0 on success, or the value main should return on failure.
+ */
+
+static int printVersions(const Grammar& grammar, const GrammarAnalysis& analysis, int start,
+			 const RSGOptions& options)
+{
+  cout << "The grammar file called \"" << options.grammarFileName << "\" contains "
+       << grammar.getNonterminalCount() << " definitions." << endl << endl;
+  
+  RandomGenerator random;
+  Expander expander(grammar);
+  unique_ptr<UniformSampler> sampler;
+  if (options.bulk.derivations != NULL) sampler.reset(new UniformSampler(*options.bulk.derivations));
+  expander.setMaxDepth(options.bulk.maxDepth);
+  expander.setMaxLength(options.bulk.maxLength);
+  unique_ptr<LengthDistribution> lengths;
+  if (options.bulk.maxChars != string::npos) {
+    lengths.reset(new LengthDistribution(grammar, analysis, options.bulk.maxChars));
+    expander.setMaxChars(*lengths);
+  }
+  string sentence;
+  for(int i = 1; i <= 3; i++)
+  {
+    cout<<"Version # " << i << ":" << endl ;
+    random.setStream(options.bulk.seed, i - 1); // same as line i of --count
+    if (sampler) {
+      sampler->sample(start, options.bulk.words, random, sentence);
+    } else if (expander.expand(start, random, sentence) != Expander::kComplete) {
+      cerr << "Version # " << i << " exceeded the maximum depth or length." << endl;
+      return 4;
+    }
+    if (!sentence.empty()) cout << " " << sentence;
+    cout<<endl<<endl;
+  }
+  
+  return 0;
 }
 
 /**
  * Performs the rudimentary error checking needed to confirm that
  * the client provided a grammar file.  It then continues to
- * open the file, read the grammar into a map<string, Definition>,
- * and then print out the total number of Definitions that were read
- * in.  You're to update and decompose the main function to print
- * three randomly generated sentences, as illustrated by the sample
- * application.
+ * load the grammar, either by reading a text grammar into a
+ * map<string, Definition> and compiling it, or by mapping an image
+ * built by an earlier rsg --compile.  With --compile, the image is
+ * written to the file named by -o and nothing is generated.  With
+ * --analyze, the grammar's analysis is printed, and the exit status is
+ * 5 if the grammar is pathological.  A grammar whose <start> can never
+ * finish is always rejected, and so is --max-chars if even the shortest
+ * sentence won't fit.  --max-chars can be at most
+ * LengthDistribution::kMaxChars, since the probability of every length
+ * up to it is computed up front, before the first sentence comes out.
+ * --derivations prints a table of derivation counts
+ * instead of generating anything, and --words is rejected if there's
+ * nothing of that length to choose from.  --profile prints a profile of
+ * the sentences instead of the sentences themselves.  --rss writes the
+ * sentences as RSS feeds instead.  With --count, the grammar is handed over
+ * to generateBulk.  Otherwise,
+ * it prints the total number of definitions followed by three randomly
+ * generated sentences.
  *
  * @param argc the number of tokens making up the command that invoked
- *             the RSG executable.  There must be at least two arguments,
- *             and only the first two are used.
+ *             the RSG executable.
  * @param argv the sequence of tokens making up the command, where each
  *             token is represented as a '\0'-terminated C string.
  */
 
 int main(int argc, char *argv[])
 {
-  if (argc == 1) {
-    cerr << "You need to specify the name of a grammar file." << endl;
-    cerr << "Usage: rsg <path to grammar text file>" << endl;
+  RSGOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    printUsage();
     return 1; // non-zero return value means something bad happened 
   }
   
-  ifstream grammarFile(argv[1]);
-  if (grammarFile.fail()) {
-    cerr << "Failed to open the file named \"" << argv[1] << "\".  Check to ensure the file exists. " << endl;
-    return 2; // each bad thing has its own bad return value
-  }
+  Grammar grammar;
+  int status = loadGrammar(options.grammarFileName, grammar);
+  if (status != 0) return status;
   
   // things are looking good...
-  map<string, Definition> grammar;
-  readGrammar(grammarFile, grammar);
-  cout << "The grammar file called \"" << argv[1] << "\" contains "
-       << grammar.size() << " definitions." << endl << endl;
+  int start = findStart(options.grammarFileName, grammar);
+  if (start == -1) return 3;
   
-  for(int i = 1; i <= 3; i++)
-  {
-    cout<<"Version # " << i << ":" << endl ;
-    getText(grammar, "<start>");
-    cout<<endl<<endl;
+  if (options.compile) {
+    if (grammar.save(options.outputFileName)) return 0;
+    cerr << "Failed to write the grammar image \"" << options.outputFileName << "\"." << endl;
+    return 2;
   }
-
-  return 0;
+  
+  GrammarAnalysis analysis(grammar, start);
+  if (options.analyze) {
+    analysis.print(cout);
+    return analysis.isPathological() ? 5 : 0;
+  }
+  
+  if (!analysis.isProductive(start)) {
+    cerr << "The grammar file called \"" << options.grammarFileName << "\" can never finish expanding <start>." << endl;
+    return 5;
+  }
+  
+  if (options.bulk.maxChars != string::npos &&
+      analysis.getMinLength(start) - 1 > options.bulk.maxChars) {
+    cerr << "The shortest sentence in the grammar file called \"" << options.grammarFileName
+	 << "\" is " << analysis.getMinLength(start) - 1 << " characters long." << endl;
+    return 5;
+  }
+  
+  if (options.profile) return profileSentences(grammar, start, options);
+  
+  if (options.derivations > 0) {
+    printDerivations(DerivationCounter(grammar, options.derivations), start);
+    return 0;
+  }
+  
+  if (options.bulk.words > 0) {
+    DerivationCounter derivations(grammar, options.bulk.words);
+    if (derivations.isInfinite(start, options.bulk.words)) {
+      cerr << "The grammar file called \"" << options.grammarFileName << "\" has infinitely many derivations"
+	   << " with " << options.bulk.words << " words, since some nonterminal can derive itself without"
+	   << " emitting any, so they can't be drawn uniformly." << endl;
+      return 5;
+    }
+    if (derivations.getApproximateCount(start, options.bulk.words).mantissa == 0) {
+      cerr << "The grammar file called \"" << options.grammarFileName << "\" has no sentences with "
+	   << options.bulk.words << " words." << endl;
+      return 5;
+    }
+    options.bulk.derivations = &derivations;
+    if (options.feeds > 0) return generateRSS(grammar, analysis, start, options);
+    if (options.bulk.count > 0) return generateSentences(grammar, analysis, start, options);
+    return printVersions(grammar, analysis, start, options);
+  }
+  
+  if (options.feeds > 0) return generateRSS(grammar, analysis, start, options);
+  if (options.bulk.count > 0) return generateSentences(grammar, analysis, start, options);
+  return printVersions(grammar, analysis, start, options);
 }
@@ -0,0 +1,108 @@
+/**
+ * File: unique.cc
+ * ---------------
+ * Provides the implementation of the SentenceSet class.  The table's
+ * size is always a power of two, so a hash's home slot is just its low
+ * bits, and the hashes are already well mixed, so nothing more is needed.
+ */
+
+#include "unique.h"
+#include <string.h>
+
+static const size_t kMinSlots = 1024;
+static const size_t kInitialSlots = 64 * 1024;
+static const uint64_t kMultiplier = 0x9e3779b97f4a7c15ULL;
+static const uint64_t kMixer = 0xbf58476d1ce4e5b9ULL;
+
+const size_t SentenceSet::kDefaultMaxBytes;
+
+/**
+ * Function: getPeakBytes
+ * ----------------------
+ * Returns the most memory a table that ends up with the specified number
+ * of slots ever occupies.  Unless it starts out that size, it's reached
+ * by growing from a table half as big, and both are alive at once.
+ */
+
+static size_t getPeakBytes(size_t slots)
+{
+  size_t peak = slots * sizeof(uint64_t);
+  if (slots > kInitialSlots) peak += slots / 2 * sizeof(uint64_t);
+  return peak;
+}
+
+SentenceSet::SentenceSet(size_t maxBytes) : count(0), maxSlots(kMinSlots)
+{
+  while (maxSlots <= SIZE_MAX / (4 * sizeof(uint64_t)) && getPeakBytes(maxSlots * 2) <= maxBytes)
+    maxSlots *= 2;
+  slots.assign(maxSlots < kInitialSlots ? maxSlots : kInitialSlots, 0);
+}
+
+static uint64_t rotate(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+/**
+ * Static Method: hash
+ * -------------------
+ * Each eight-byte word (and then whatever's left, padded with zeroes)
+ * is multiplied into the running hash, and the result is run through
+ * the SplitMix64 finalizer.  The length is folded in first, so texts
+ * that differ only in trailing zero bytes still hash differently.
+ */
+
+uint64_t SentenceSet::hash(const char *text, size_t length)
+{
+  uint64_t h = length * kMultiplier;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, text + i, sizeof(word));
+    h = rotate(h ^ (word * kMixer), 29) * kMultiplier;
+  }
+  uint64_t tail = 0;
+  memcpy(&tail, text + i, length - i);
+  h = rotate(h ^ (tail * kMixer), 29) * kMultiplier;
+
+  h = (h ^ (h >> 30)) * kMixer;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+  return h ^ (h >> 31);
+}
+
+SentenceSet::Outcome SentenceSet::add(uint64_t hash)
+{
+  if (hash == 0) hash = 1; // 0 is reserved for empty slots
+  size_t mask = slots.size() - 1;
+  size_t i = hash & mask;
+  while (slots[i] != 0) {
+    if (slots[i] == hash) return kRepeated;
+    i = (i + 1) & mask;
+  }
+
+  if ((count + 1) * 4 > slots.size() * 3) {
+    if (slots.size() >= maxSlots) return kFull;
+    grow();
+    return add(hash);
+  }
+
+  slots[i] = hash;
+  count++;
+  return kAdded;
+}
+
+/**
+ * Method: grow
+ * ------------
+ * Doubles the table and reinserts every hash.
+ */
+
+void SentenceSet::grow()
+{
+  vector<uint64_t> old(slots.size() * 2, 0);
+  old.swap(slots);
+  size_t mask = slots.size() - 1;
+  for (size_t j = 0; j < old.size(); j++) {
+    if (old[j] == 0) continue;
+    size_t i = old[j] & mask;
+    while (slots[i] != 0) i = (i + 1) & mask;
+    slots[i] = old[j];
+  }
+}
@@ -0,0 +1,87 @@
+/**
+ * File: unique.h
+ * --------------
+ * Defines the SentenceSet class, which remembers which sentences
+ * have already been written so that rsg --unique can drop repeats.
+ * Only a 64-bit hash of each sentence is kept, in a single open-addressing
+ * table with linear probing, so every distinct sentence costs the same
+ * few bytes however long it is.  The table doubles whenever it's three
+ * quarters full, but never past its memory budget, which has to cover the
+ * old table as well as the new one while the hashes are moved over.
+ *
+ * Two different sentences share a hash with probability 2^-64, so among
+ * n distinct sentences, the chance that any one of them is mistaken for
+ * a repeat is about n^2 / 2^65: roughly one in a hundred thousand for
+ * twenty million sentences.
+ */
+
+#ifndef __unique__
+#define __unique__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+using namespace std;
+
+class SentenceSet {
+
+ public:
+
+  static const size_t kDefaultMaxBytes = 512 * 1024 * 1024;
+
+  /**
+   * Type: Outcome
+   * -------------
+   * Describes what add did with a hash.  kFull means the hash was new,
+   * but the table had no room left for it within its budget.
+   */
+
+  enum Outcome { kAdded, kRepeated, kFull };
+
+  /**
+   * Constructor: SentenceSet
+   * ------------------------
+   * Constructs an empty set that will never occupy more than the
+   * specified number of bytes (or a few kilobytes, if that's less),
+   * counting both tables while the table is growing.
+   */
+
+  SentenceSet(size_t maxBytes = kDefaultMaxBytes);
+
+  /**
+   * Static Method: hash
+   * -------------------
+   * Returns a 64-bit hash of the specified text, consuming it eight
+   * bytes at a time.
+   */
+
+  static uint64_t hash(const char *text, size_t length);
+
+  /**
+   * Method: add
+   * -----------
+   * Adds the specified hash to the set, growing the table if need be,
+   * and reports whether it was already there.
+   */
+
+  Outcome add(uint64_t hash);
+
+  /**
+   * Methods: size, getCapacity
+   * --------------------------
+   * size returns the number of distinct hashes added so far, and
+   * getCapacity the number the set can hold before add reports kFull.
+   */
+
+  size_t size() const { return count; }
+  size_t getCapacity() const { return maxSlots / 4 * 3; }
+
+ private:
+  vector<uint64_t> slots;        // 0 marks an empty slot
+  size_t count;
+  size_t maxSlots;
+
+  void grow();
+};
+
+#endif // ! __unique__
@@ -0,0 +1,34 @@
+#include <iostream>
+#include "imdb.h"
+using namespace std;
+
+/**
+ * Serves as the main entry point for the imdb-index executable, which
+ * builds the co-star index for the data files in the specified directory
+ * (or the usual one) and writes it alongside them.  Every imdb opened on
+ * that directory afterwards maps the index, and six-degrees then walks
+ * straight from actor to actor instead of through every film's cast.
+ * The index has to be rebuilt whenever the data files change; until it
+ * is, it's ignored.
+ *
+ * @param argc the number of tokens passed to the command line.
+ * @param argv the C strings making up the full command line.  argv[1],
+ *             if present, names the directory holding the data files.
+ * @return 0 if the index was written, and 1 otherwise.
+ */
+
+int main(int argc, const char *argv[])
+{
+  string directory = argc > 1 ? argv[1] : determinePathToData(); // inlined in imdb-utils.h
+  imdb db(directory);
+  if (!db.good()) {
+    cerr << "Failed to properly initialize the imdb database in \"" << directory << "\"." << endl;
+    return 1;
+  }
+
+  if (!db.writeCostarIndex(directory)) {
+    cerr << "Failed to write the co-star index into \"" << directory << "\"." << endl;
+    return 1;
+  }
+  return 0;
+}
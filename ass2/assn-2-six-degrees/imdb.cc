@@ -6,10 +6,15 @@ using namespace std;
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdio.h>
+#include <algorithm>
 #include "imdb.h"
 
 const char *const imdb::kActorFileName = "actordata";
 const char *const imdb::kMovieFileName = "moviedata";
+const char *const imdb::kCostarFileName = "costardata";
+const int imdb::kNoRecord;
+static const char kCostarMagic[8] = { 'C', 'O', 'S', 'T', 'A', 'R', 'S', '2' };
 
 struct key
 {
@@ -24,6 +29,127 @@ imdb::imdb(const string& directory)
   
   actorFile = acquireFileMap(actorFileName, actorInfo);
   movieFile = acquireFileMap(movieFileName, movieInfo);
+
+  acquireFileMap(directory + "/" + kCostarFileName, costarInfo);
+  if (!attachCostarIndex()) {
+    releaseFileMap(costarInfo);
+    costarInfo.fd = -1;
+    costarInfo.fileMap = NULL;
+    costarRows = NULL;
+    costars = NULL;
+  }
+}
+
+/**
+ * Checks that the mapped co-star index was built from the data files
+ * that are mapped alongside it, and that it's exactly as long as its
+ * header says, before pointing costarRows and costars into it.  The data
+ * files have to match in modification time as well as size, since a
+ * rebuilt database can easily come out exactly as long as the old one.
+ * The rows themselves are then checked by isCostarIndexConsistent.
+ */
+
+bool imdb::attachCostarIndex()
+{
+  if (!good() || costarInfo.fileMap == NULL || costarInfo.fileSize < sizeof(costarHeader)) return false;
+  const costarHeader *header = (const costarHeader *) costarInfo.fileMap;
+  if (memcmp(header->magic, kCostarMagic, sizeof(kCostarMagic)) != 0 ||
+      header->actorFileSize != actorInfo.fileSize || header->movieFileSize != movieInfo.fileSize ||
+      header->actorModified != actorInfo.modified || header->movieModified != movieInfo.modified ||
+      (int) header->actorIDLimit != getActorIDLimit() ||
+      costarInfo.fileSize != sizeof(costarHeader) + (header->actorIDLimit + 1) * sizeof(uint32_t) +
+                             (size_t) header->costarCount * sizeof(costar))
+    return false;
+  costarRows = (const uint32_t *)(header + 1);
+  costars = (const costar *)(costarRows + header->actorIDLimit + 1);
+  return isCostarIndexConsistent(header->actorIDLimit, header->costarCount);
+}
+
+/**
+ * Confirms that the row offsets never decrease and account for every
+ * co-star exactly, and that every co-star names an actor and a film
+ * that lie within the data files, which is all getCostars and its
+ * callers need to stay in bounds.  It costs one pass over the index.
+ */
+
+bool imdb::isCostarIndexConsistent(uint32_t idLimit, uint32_t costarCount) const
+{
+  if (costarRows[0] != 0 || costarRows[idLimit] != costarCount) return false;
+  for (uint32_t id = 0; id < idLimit; id++)
+    if (costarRows[id] > costarRows[id + 1]) return false;
+
+  int movieIDLimit = getMovieIDLimit();
+  for (uint32_t i = 0; i < costarCount; i++) {
+    if (costars[i].actor < 0 || costars[i].actor >= (int) idLimit ||
+        costars[i].movie < 0 || costars[i].movie >= movieIDLimit)
+      return false;
+  }
+  return true;
+}
+
+/**
+ * Every actor's row is built by walking the actor's credits and each
+ * film's cast, using lastSeen (indexed by actor ID) to skip co-stars
+ * already listed in the row, so no set is needed.  The rows have to be
+ * laid out in ID order, and the actor table is in name order, so the IDs
+ * are sorted first.  Rows are streamed to the file as they're built;
+ * the row offsets and header are filled in once they're all known.
+ */
+
+bool imdb::writeCostarIndex(const string& directory) const
+{
+  int idLimit = getActorIDLimit();
+  int nActors = *(int *)actorFile;
+  vector<int> actors;
+  for (int i = 0; i < nActors; i++)
+    actors.push_back(((const int *) actorFile)[i + 1] / sizeof(int));
+  sort(actors.begin(), actors.end());
+
+  const string fileName = directory + "/" + kCostarFileName;
+  const string temporaryName = fileName + ".tmp";
+  FILE *outfile = fopen(temporaryName.c_str(), "wb");
+  if (outfile == NULL) return false;
+
+  vector<uint32_t> rows(idLimit + 1);
+  vector<int> lastSeen(idLimit, kNoRecord);
+  vector<costar> row;
+  bool written = fseek(outfile, sizeof(costarHeader) + rows.size() * sizeof(uint32_t), SEEK_SET) == 0;
+  uint64_t costarCount = 0;
+  for (int i = 0, id = 0; id <= idLimit && written; id++) {
+    rows[id] = costarCount;
+    if (i == nActors || actors[i] != id) continue;
+    i++;
+
+    row.clear();
+    idSpan credits = getCredits(id);
+    for (int j = 0; j < credits.size(); j++) {
+      idSpan cast = getCast(credits[j]);
+      for (int k = 0; k < cast.size(); k++) {
+        if (cast[k] == id || lastSeen[cast[k]] == id) continue;
+        lastSeen[cast[k]] = id;
+        costar edge = { cast[k], credits[j] };
+        row.push_back(edge);
+      }
+    }
+    costarCount += row.size();
+    written = costarCount <= UINT32_MAX && fwrite(row.data(), sizeof(costar), row.size(), outfile) == row.size();
+  }
+
+  costarHeader header;
+  memcpy(header.magic, kCostarMagic, sizeof(kCostarMagic));
+  header.actorFileSize = actorInfo.fileSize;
+  header.movieFileSize = movieInfo.fileSize;
+  header.actorModified = actorInfo.modified;
+  header.movieModified = movieInfo.modified;
+  header.actorIDLimit = idLimit;
+  header.costarCount = costarCount;
+  written = written && fseek(outfile, 0, SEEK_SET) == 0 &&
+            fwrite(&header, sizeof(header), 1, outfile) == 1 &&
+            fwrite(rows.data(), sizeof(uint32_t), rows.size(), outfile) == rows.size();
+  if (fclose(outfile) != 0) written = false;
+  if (written && rename(temporaryName.c_str(), fileName.c_str()) == 0) return true;
+  remove(temporaryName.c_str());
+  return false;
 }
 
 bool imdb::good() const
@@ -44,9 +170,24 @@ int compareActors(const void * a, const void * b)
 	
 }
 
-// you should be implementing these two methods right here... 
-bool imdb::getCredits(const string& player, vector<film>& films) const 
-{	
+/**
+ * Every record opens with a header (the actor's name, or the movie's title
+ * and year byte) padded out to an even length, followed by a short count,
+ * padding out to a four-byte boundary, and then that many int offsets into
+ * the other file.  This returns the address of the first offset.
+ */
+
+const int *imdb::getEntries(const char *record, size_t headerLength, int& count)
+{
+  size_t len = headerLength + headerLength % 2;
+  count = *(const short *)(record + len);
+  len += sizeof(short);
+  len += len % sizeof(int);
+  return (const int *)(record + len);
+}
+
+int imdb::getActorID(const string& player) const
+{
 	int nActors = *(int *)actorFile;
 	
 	key data;
@@ -56,59 +197,71 @@ bool imdb::getCredits(const string& player, vector<film>& films) const
 	int * pointerToOffset = (int *)bsearch(&data, (char *)actorFile + sizeof(int), nActors, 
 											sizeof(int), compareActors);
 	if(pointerToOffset == NULL)
-		return false; //there's no actor named player.
+		return kNoRecord; //there's no actor named player.
+	return *pointerToOffset / sizeof(int);
+}
 
-	char * playerPos = (char *)actorFile + *pointerToOffset;
+imdb::idSpan imdb::getCredits(int actor) const
+{
+	string_view name = getActorName(actor);
+	int nMovies;
+	const int *firstMovie = getEntries(name.data(), name.size() + 1, nMovies);
+	return idSpan(firstMovie, nMovies);
+}
 
-	int len = strlen(playerPos) % 2 == 1 ? strlen(playerPos) + 1 : strlen(playerPos) + 2;
-	short *nMovies = (short *)(playerPos + len);
+string_view imdb::getActorName(int actor) const
+{
+	return (const char *)actorFile + actor * sizeof(int);
+}
 
-	len += sizeof(short);
+string_view imdb::getTitle(int movie) const
+{
+	return (const char *)movieFile + movie * sizeof(int);
+}
 
-	int *firstMovie;
-	if(len % 4 == 0)
-		firstMovie= (int *)(nMovies + 1);
-	else
-		firstMovie = (int *)((char *)nMovies + sizeof(short) + 2);
+int imdb::getYear(int movie) const
+{
+	string_view title = getTitle(movie);
+	return title.data()[title.size() + 1] + 1900;
+}
 
-	for(int i = 0; i < *nMovies; i++)
-	{
-		int currMoviePos = *(firstMovie + i);
-		char * currMovie = (char *)movieFile + currMoviePos;
-		
-		int currYear = *(char *)(currMovie + strlen(currMovie) + 1);
-		
-		film currFilm;
-		currFilm.title = currMovie;
-		currFilm.year = currYear + 1900;
+film imdb::getFilm(int movie) const
+{
+	film currFilm;
+	currFilm.title = getTitle(movie);
+	currFilm.year = getYear(movie);
+	return currFilm;
+}
 
-		films.push_back(currFilm);
-	}
+bool imdb::getCredits(const string& player, vector<film>& films) const 
+{	
+	int actor = getActorID(player);
+	if(actor == kNoRecord)
+		return false;
+
+	idSpan movies = getCredits(actor);
+	for(int i = 0; i < movies.size(); i++)
+		films.push_back(getFilm(movies[i]));
 
 	return true;
 }
 
+// orders films exactly as film::operator< does, but straight from the
+// mapped record, without building a film to compare against.
 int compareMovies(const void * a, const void * b)
 {
 	key *data = (key*)a;
 	int bytesToOffset = *(int *)b;
+	const film& movie = *(const film *)data->value;
 
-	char * movieName = (char *)((char *)data->file + bytesToOffset);
-	int movieYear = *(char *)(movieName + strlen(movieName) + 1);
-
-	film film2;
-	film2.title = movieName;
-	film2.year = movieYear + 1900;
-
-	if(*(film *)data->value == film2)
-		return 0;
-	else if(*(film *)data->value < film2)
-		return -1;
-
-	return 1;
+	const char * movieName = (const char *)data->file + bytesToOffset;
+	int order = string_view(movie.title).compare(movieName);
+	if(order != 0)
+		return order;
+	return movie.year - (*(movieName + strlen(movieName) + 1) + 1900);
 }
 
-bool imdb::getCast(const film& movie, vector<string>& players) const
+int imdb::getMovieID(const film& movie) const
 {
 	int nMovies = *(int *)movieFile;
 
@@ -118,28 +271,27 @@ bool imdb::getCast(const film& movie, vector<string>& players) const
 	int *pointerToOffset = (int *)bsearch(&data, (char *)movieFile + sizeof(int), nMovies,
 											sizeof(int), compareMovies);
 	if(pointerToOffset == NULL)
-		return false;
-
-	char *moviePos = (char *)movieFile + *pointerToOffset;
-
-	int len = (strlen(moviePos) + 1) % 2 == 1 ? strlen(moviePos) + 2 : strlen(moviePos) + 3;
-	short *nPlayers = (short *)(moviePos + len);
-	
-	len += sizeof(short);
+		return kNoRecord;
+	return *pointerToOffset / sizeof(int);
+}
 
-	int *firstPlayer;
-	if(len % 4 == 0)
-		firstPlayer = (int *)(nPlayers + 1);
-	else
-		firstPlayer = (int *)((char *)nPlayers + sizeof(short) + 2);
+imdb::idSpan imdb::getCast(int movie) const
+{
+	string_view title = getTitle(movie);
+	int nPlayers;
+	const int *firstPlayer = getEntries(title.data(), title.size() + 2, nPlayers);
+	return idSpan(firstPlayer, nPlayers);
+}
 
-	for(int i = 0; i < *nPlayers; i++)
-	{
-		int currPlayerPos = *(firstPlayer + i); 
-		char * currPlayer = (char *)actorFile + currPlayerPos;
+bool imdb::getCast(const film& movie, vector<string>& players) const
+{
+	int id = getMovieID(movie);
+	if(id == kNoRecord)
+		return false;
 
-		players.push_back(currPlayer);
-	}
+	idSpan cast = getCast(id);
+	for(int i = 0; i < cast.size(); i++)
+		players.push_back(string(getActorName(cast[i])));
 
 	return true;
 }
@@ -148,6 +300,7 @@ imdb::~imdb()
 {
   releaseFileMap(actorInfo);
   releaseFileMap(movieInfo);
+  releaseFileMap(costarInfo);
 }
 
 // ignore everything below... it's all UNIXy stuff in place to make a file look like
@@ -155,10 +308,15 @@ imdb::~imdb()
 const void *imdb::acquireFileMap(const string& fileName, struct fileInfo& info)
 {
   struct stat stats;
-  stat(fileName.c_str(), &stats);
-  info.fileSize = stats.st_size;
+  info.fileSize = 0;
+  info.modified = 0;
+  info.fileMap = NULL;
   info.fd = open(fileName.c_str(), O_RDONLY);
-  return info.fileMap = mmap(0, info.fileSize, PROT_READ, MAP_SHARED, info.fd, 0);
+  if (info.fd == -1 || fstat(info.fd, &stats) == -1 || stats.st_size == 0) return NULL;
+  info.fileSize = stats.st_size;
+  info.modified = (int64_t) stats.st_mtim.tv_sec * 1000000000 + stats.st_mtim.tv_nsec;
+  void *fileMap = mmap(0, info.fileSize, PROT_READ, MAP_SHARED, info.fd, 0);
+  return info.fileMap = (fileMap == MAP_FAILED) ? NULL : fileMap;
 }
 
 void imdb::releaseFileMap(struct fileInfo& info)
@@ -2,7 +2,9 @@
 #define __imdb__
 
 #include "imdb-utils.h"
+#include <stdint.h>
 #include <string>
+#include <string_view>
 #include <vector>
 using namespace std;
 
@@ -74,6 +76,160 @@ class imdb {
 
   bool getCast(const film& movie, vector<string>& players) const;
 
+  /**
+   * Methods: getActorID, getMovieID
+   * -------------------------------
+   * Look up the record for the specified actor/actress or film and return
+   * its ID, or kNoRecord if there isn't one.  A record's ID is its byte
+   * offset within its data file divided by four (every record starts on a
+   * four-byte boundary), so IDs are unique, never change, and are all less
+   * than getActorIDLimit() or getMovieIDLimit().  That makes them suitable
+   * indices into flat arrays and bitmaps, which is what searches like
+   * six-degrees' want, since comparing and copying IDs is far cheaper
+   * than comparing and copying names.
+   */
+
+  static const int kNoRecord = -1;
+
+  int getActorID(const string& player) const;
+  int getMovieID(const film& movie) const;
+  int getActorIDLimit() const { return actorInfo.fileSize / sizeof(int); }
+  int getMovieIDLimit() const { return movieInfo.fileSize / sizeof(int); }
+
+  /**
+   * Class: idSpan
+   * -------------
+   * A lightweight view of the array of offsets at the end of an actor's
+   * or a film's record, right where it sits in the mapped file.  It's
+   * only a pointer and a count, so it's as cheap to copy as an int, and
+   * each element is converted to an ID only as it's read.  A span is
+   * valid for as long as the imdb that produced it.
+   */
+
+  class idSpan {
+   public:
+    idSpan() : first(NULL), count(0) {}
+    int size() const { return count; }
+    bool empty() const { return count == 0; }
+    int operator[](int i) const { return first[i] / sizeof(int); }
+
+   private:
+    friend class imdb;
+    idSpan(const int *first, int count) : first(first), count(count) {}
+    const int *first;
+    int count;
+  };
+
+  /**
+   * Methods: getCredits, getCast
+   * ----------------------------
+   * Return spans of the IDs of the specified actor's/actress's films, or
+   * of the specified film's cast.  Nothing is copied or decoded, and
+   * nothing is allocated.
+   */
+
+  idSpan getCredits(int actor) const;
+  idSpan getCast(int movie) const;
+
+  /**
+   * Methods: getActorName, getTitle, getYear
+   * ----------------------------------------
+   * Return the name of the actor/actress, or the title or year of the film,
+   * with the specified ID.  The names and titles are views of the mapped
+   * files, so they're as long-lived as the imdb and cost nothing to return.
+   */
+
+  string_view getActorName(int actor) const;
+  string_view getTitle(int movie) const;
+  int getYear(int movie) const;
+
+  /**
+   * Method: getFilm
+   * ---------------
+   * Decodes the title and year of the film with the specified ID
+   * into a film of its own.
+   */
+
+  film getFilm(int movie) const;
+
+  /**
+   * Struct: costar
+   * --------------
+   * One edge of the co-star graph: the ID of an actor/actress who shares
+   * at least one film with another, and the ID of one such film.
+   */
+
+  struct costar {
+    int actor;
+    int movie;
+  };
+
+  /**
+   * Class: costarSpan
+   * -----------------
+   * A lightweight view of one actor's/actress's row of the co-star index,
+   * right where it sits in the mapped file, along the lines of idSpan.
+   */
+
+  class costarSpan {
+   public:
+    costarSpan() : first(NULL), count(0) {}
+    int size() const { return count; }
+    bool empty() const { return count == 0; }
+    const costar& operator[](int i) const { return first[i]; }
+
+   private:
+    friend class imdb;
+    costarSpan(const costar *first, int count) : first(first), count(count) {}
+    const costar *first;
+    int count;
+  };
+
+  /**
+   * Predicate Method: hasCostarIndex
+   * --------------------------------
+   * Returns true if and only if the directory passed to the constructor
+   * holds a co-star index (written by imdb-index, or by writeCostarIndex)
+   * that was built from these very data files, as judged by their sizes
+   * and modification times.  A missing, stale, or damaged index is
+   * simply ignored, so copying the data files without preserving their
+   * times (cp -p does) means rebuilding the index.  Damage is caught as
+   * far as it would send a lookup out of bounds: every row and every
+   * co-star is checked when the index is opened.
+   */
+
+  bool hasCostarIndex() const { return costarRows != NULL; }
+
+  /**
+   * Method: getCostars
+   * ------------------
+   * Returns the specified actor's/actress's co-stars, each listed
+   * exactly once, along with the first of the actor's/actress's films (in
+   * credit order) that they share.  Co-stars are listed in the order
+   * they're first met walking the credits and then each film's cast.
+   * There must be a co-star index.
+   */
+
+  costarSpan getCostars(int actor) const
+  {
+    return costarSpan(costars + costarRows[actor], costarRows[actor + 1] - costarRows[actor]);
+  }
+
+  /**
+   * Method: writeCostarIndex
+   * ------------------------
+   * Builds the co-star index for the receiving imdb and writes it into
+   * the specified directory, alongside the data files, where later imdbs
+   * will find it.  The index is a compressed sparse row graph: a row
+   * offset for every possible actor ID, followed by every row's co-stars
+   * back to back.  It's written to a temporary file and renamed into
+   * place, so a reader never sees half of one.
+   *
+   * @return true if and only if the entire index was written.
+   */
+
+  bool writeCostarIndex(const string& directory) const;
+
   /**
    * Destructor: ~imdb
    * -----------------
@@ -86,17 +242,35 @@ class imdb {
  private:
   static const char *const kActorFileName;
   static const char *const kMovieFileName;
+  static const char *const kCostarFileName;
   const void *actorFile;
   const void *movieFile;
+  const uint32_t *costarRows;          // actor ID -> first co-star, one extra entry at the end
+  const costar *costars;               // every row of co-stars, back to back
   
   // everything below here is complicated and needn't be touched.
   // you're free to investigate, but you're on your own.
   struct fileInfo {
     int fd;
     size_t fileSize;
+    int64_t modified;                  // st_mtim, in nanoseconds since the epoch
     const void *fileMap;
-  } actorInfo, movieInfo;
+  } actorInfo, movieInfo, costarInfo;
   
+  struct costarHeader {
+    char magic[8];
+    uint32_t actorFileSize;            // the data files the index was built from
+    uint32_t movieFileSize;
+    uint32_t actorIDLimit;
+    uint32_t costarCount;
+    int64_t actorModified;             // ... and when they were last modified
+    int64_t movieModified;
+  };
+
+  bool attachCostarIndex();
+  bool isCostarIndexConsistent(uint32_t idLimit, uint32_t costarCount) const;
+  static const int *getEntries(const char *record, size_t headerLength, int& count);
+
   static const void *acquireFileMap(const string& fileName, struct fileInfo& info);
   static void releaseFileMap(struct fileInfo& info);
 
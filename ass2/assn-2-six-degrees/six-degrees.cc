@@ -1,6 +1,4 @@
 #include <vector>
-#include <list>
-#include <set>
 #include <string>
 #include <iostream>
 #include <iomanip>
@@ -37,50 +35,182 @@ static string promptForActor(const string& prompt, const imdb& db)
   }
 }
 
-bool generateShortestPath(const string& source, const string& target, const imdb& db)
+/**
+ * Struct: searchSide
+ * ------------------
+ * One half of the bidirectional search in generateShortestPath.
+ * Everything is keyed on imdb record IDs rather than names: discovered
+ * holds, for every possible actor ID, the index of that actor's entry in
+ * discoveries (or -1 if there isn't one yet), and previouslySeenFilms is
+ * a bitmap with one bit per possible film ID.
+ * discoveries lists every actor this side has discovered, in order,
+ * each with the film it was discovered through and the index of the
+ * discovery it was reached from (the end itself has none).  Since the
+ * search is breadth-first, the actors at the deepest level, who are the
+ * next to be expanded, are always the last ones discovered: everything
+ * from frontierStart on.  depth is their distance from the end.  Nothing
+ * is ever copied from one discovery to the next, and a path is only
+ * built once, by following the parent indices back from where the sides
+ * met.
+ */
+
+struct searchSide {
+  struct discovery {
+    int actor;
+    int movie;
+    int parent;
+  };
+
+  vector<int> discovered;
+  vector<bool> previouslySeenFilms;
+  vector<discovery> discoveries;
+  unsigned frontierStart;
+  int depth;
+
+  searchSide(int player, const imdb& db) :
+    discovered(db.getActorIDLimit(), -1), previouslySeenFilms(db.getMovieIDLimit()),
+    frontierStart(0), depth(0)
+  {
+    discovered[player] = 0;
+    discovery end = { player, imdb::kNoRecord, -1 };
+    discoveries.push_back(end);
+  }
+
+  unsigned getFrontierSize() const { return discoveries.size() - frontierStart; }
+
+  bool hasDiscovered(int player) const { return discovered[player] != -1; }
+};
+
+static const int kMaxPathLength = 5;
+
+/**
+ * Records that the specified actor was discovered from the specified
+ * discovery by way of the specified film, unless this side has already
+ * discovered them.  If the other side has too, the two sides have met.
+ *
+ * @return true if and only if the two sides met.
+ */
+
+static bool discover(searchSide& side, const searchSide& other, int player, int movie, int from)
 {
-	list<path> partialPaths;
-	set<string> previouslySeenActors;
-	set<film> previouslySeenFilms;
+	if(side.hasDiscovered(player))
+		return false;
 
-	partialPaths.push_back(path(source));
+	side.discovered[player] = side.discoveries.size();
+	searchSide::discovery found = { player, movie, from };
+	side.discoveries.push_back(found);
+	return other.hasDiscovered(player);
+}
 
-	while(!partialPaths.empty() && partialPaths.front().getLength() < 5)
-	{
-		path frontPath = partialPaths.front();
-		partialPaths.pop_front();
+/**
+ * Expands every actor in the side's frontier by one level, recording
+ * each newly discovered co-star, who together make up the next frontier.
+ * Expansion stops early the moment a co-star that the other side has
+ * already discovered turns up, leaving that actor as the side's last
+ * discovery.
+ * With a co-star index, each actor's co-stars are read straight from
+ * it.  Otherwise they're found by way of every film not yet seen from
+ * this side.  Either way, co-stars are discovered in the same order and
+ * through the same films, so the paths found are the same.
+ *
+ * @return true if and only if the two sides met.
+ */
 
-		vector<film> lastPlayerMovies;
-		db.getCredits(frontPath.getLastPlayer(), lastPlayerMovies);
+static bool expandFrontier(searchSide& side, const searchSide& other, const imdb& db)
+{
+	unsigned frontierEnd = side.discoveries.size();
+	for(unsigned i = side.frontierStart; i < frontierEnd; i++)
+	{
+		int player = side.discoveries[i].actor;
+		if(db.hasCostarIndex())
+		{
+			imdb::costarSpan costars = db.getCostars(player);
+			for(int j = 0; j < costars.size(); j++)
+				if(discover(side, other, costars[j].actor, costars[j].movie, i))
+					return true;
+			continue;
+		}
 
-		for(unsigned i = 0; i < lastPlayerMovies.size(); i++)
+		imdb::idSpan credits = db.getCredits(player);
+		for(int j = 0; j < credits.size(); j++)
 		{
-			if(previouslySeenFilms.count(lastPlayerMovies[i]))
+			if(side.previouslySeenFilms[credits[j]])
 				continue;
+			side.previouslySeenFilms[credits[j]] = true;
 
-			previouslySeenFilms.insert(lastPlayerMovies[i]);
+			imdb::idSpan cast = db.getCast(credits[j]);
+			for(int k = 0; k < cast.size(); k++)
+				if(discover(side, other, cast[k], credits[j], i))
+					return true;
+		}
+	}
 
-			vector<string> currMovieCast;
-			db.getCast(lastPlayerMovies[i], currMovieCast);
+	side.frontierStart = frontierEnd;
+	side.depth++;
+	return false;
+}
 
-			for(unsigned j = 0; j < currMovieCast.size(); j++)
-			{
-				if(previouslySeenActors.count(currMovieCast[j]))
-					continue;
+/**
+ * Builds the path from the source to the target, given the indices of
+ * the meeting actor's discoveries on either side, by following each
+ * side's parent indices outward.  This is the only place names and
+ * titles are decoded.
+ */
 
-				previouslySeenActors.insert(currMovieCast[j]);
+static path stitchPath(const searchSide& fromSource, int sourceMeeting,
+		       const searchSide& fromTarget, int targetMeeting, const imdb& db)
+{
+	vector<int> firstHalf;
+	for(int i = sourceMeeting; fromSource.discoveries[i].parent != -1; i = fromSource.discoveries[i].parent)
+		firstHalf.push_back(i);
 
-				path clone = path(frontPath);
-				clone.addConnection(lastPlayerMovies[i], currMovieCast[j]);
+	path result(string(db.getActorName(fromSource.discoveries[0].actor)));
+	for(int i = firstHalf.size() - 1; i >= 0; i--)
+	{
+		const searchSide::discovery& step = fromSource.discoveries[firstHalf[i]];
+		result.addConnection(db.getFilm(step.movie), string(db.getActorName(step.actor)));
+	}
 
-				if(currMovieCast[j] == target)
-				{
-					cout << clone << endl;
-					return true;
-				}
+	for(int i = targetMeeting; fromTarget.discoveries[i].parent != -1; i = fromTarget.discoveries[i].parent)
+	{
+		const searchSide::discovery& step = fromTarget.discoveries[i];
+		int next = fromTarget.discoveries[step.parent].actor;
+		result.addConnection(db.getFilm(step.movie), string(db.getActorName(next)));
+	}
+	return result;
+}
+
+/**
+ * Searches outward from both the source and the target at once, always
+ * expanding whichever side has the smaller frontier by a full level.  The
+ * first actor discovered from both sides lies on a shortest path, since
+ * neither side had reached any of the other's actors before that level.
+ * As before, paths of more than kMaxPathLength films aren't considered.
+ */
 
-				partialPaths.push_back(clone);
-			}
+bool generateShortestPath(const string& source, const string& target, const imdb& db)
+{
+	int sourceID = db.getActorID(source), targetID = db.getActorID(target);
+	if(sourceID == imdb::kNoRecord || targetID == imdb::kNoRecord)
+		return false;
+
+	searchSide fromSource(sourceID, db), fromTarget(targetID, db);
+	while(fromSource.getFrontierSize() > 0 && fromTarget.getFrontierSize() > 0 &&
+	      fromSource.depth + fromTarget.depth < kMaxPathLength)
+	{
+		bool sourceSmaller = fromSource.getFrontierSize() <= fromTarget.getFrontierSize();
+		searchSide& side = sourceSmaller ? fromSource : fromTarget;
+		const searchSide& other = sourceSmaller ? fromTarget : fromSource;
+
+		if(expandFrontier(side, other, db))
+		{
+			int meeting = side.discoveries.size() - 1;
+			int otherMeeting = other.discovered[side.discoveries[meeting].actor];
+			if(sourceSmaller)
+				cout << stitchPath(fromSource, meeting, fromTarget, otherMeeting, db) << endl;
+			else
+				cout << stitchPath(fromSource, otherMeeting, fromTarget, meeting, db) << endl;
+			return true;
 		}
 	}
 	return false;